@@ -0,0 +1,141 @@
+//
+// backends.h - what bench.c and render.c share
+//
+// the table of the CPU backends, (every one compiled with its own prefix,
+// see voronoi_compute.h) our own random, so the runs are the same on every
+// machine, and the same random walk as main.c, with a fixed timestep.
+//
+// #define BACKENDS_IMPLEMENTATION in exactly one file. (bench.c, render.c)
+//
+
+#ifndef BACKENDS_H_
+#define BACKENDS_H_
+
+#include <stddef.h>
+
+#include "ints.h"
+
+
+#define DECLARE_BACKEND(prefix)                                                                                                  \
+    void prefix##init_voronoi(void);                                                                                             \
+    void prefix##compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points);             \
+    void prefix##finish_voronoi(void);
+
+DECLARE_BACKEND(simple_)
+DECLARE_BACKEND(simple_threaded_)
+DECLARE_BACKEND(with_math_)
+DECLARE_BACKEND(jfa_)
+DECLARE_BACKEND(fortune_)
+DECLARE_BACKEND(kinetic_)
+
+
+typedef struct Backend {
+    const char *name;
+    void (*init)(void);
+    void (*compute)(u32 *labels, size_t width, size_t height, const float *points, size_t num_points);
+    void (*finish)(void);
+} Backend;
+
+// (a new backend goes in here, and in backends[])
+#define NUM_BACKENDS 6
+extern Backend backends[NUM_BACKENDS];
+
+// NULL if theres no backend called 'name'
+Backend *find_backend(const char *name);
+
+
+// same as main.c, in pixels per second
+#define SPEED 100
+// the fixed timestep the points are moved by between frames
+#define FRAME_DELTA (1.0f / 60.0f)
+
+// https://prng.di.unimi.it/splitmix64.c
+extern u64 rng_state;
+u64   rng_next(void);
+// in [0, 1)
+float rng_float(void);
+
+
+// the same layout as a raylib Vector2
+typedef struct Point {
+    float x, y;
+} Point;
+
+// like add_new_point() in main.c, SPEED at most, either way.
+Point random_velocity(void);
+// moves the points in [start, end) by a frame, they bounce off the edges.
+void walk_points(Point *pos, Point *vel, u64 start, u64 end, u64 width, u64 height);
+
+#endif // BACKENDS_H_
+
+
+#ifdef BACKENDS_IMPLEMENTATION
+
+#ifndef BACKENDS_IMPLEMENTATION_
+#define BACKENDS_IMPLEMENTATION_
+
+#include <string.h>
+#include <math.h>
+
+#define BACKEND(prefix, name) {name, prefix##init_voronoi, prefix##compute_voronoi, prefix##finish_voronoi}
+
+Backend backends[NUM_BACKENDS] = {
+    BACKEND(simple_,          "simple"),
+    BACKEND(simple_threaded_, "simple_threaded"),
+    BACKEND(with_math_,       "with_math"),
+    BACKEND(jfa_,             "jfa"),
+    BACKEND(fortune_,         "fortune"),
+    BACKEND(kinetic_,         "kinetic"),
+};
+
+Backend *find_backend(const char *name) {
+    for (u64 b = 0; b < NUM_BACKENDS; b++) {
+        if (strcmp(backends[b].name, name) == 0) return &backends[b];
+    }
+    return NULL;
+}
+
+
+u64 rng_state;
+
+u64 rng_next(void) {
+    u64 z = (rng_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+float rng_float(void) {
+    return (rng_next() >> 40) / (float) (1 << 24);
+}
+
+
+Point random_velocity(void) {
+    Point vel = {
+        .x = (rng_float() * (SPEED-1) + 1),
+        .y = (rng_float() * (SPEED-1) + 1),
+    };
+    if (rng_next() % 2) vel.x *= -1;
+    if (rng_next() % 2) vel.y *= -1;
+    return vel;
+}
+
+void walk_points(Point *pos, Point *vel, u64 start, u64 end, u64 width, u64 height) {
+    for (u64 i = start; i < end; i++) {
+        Point *xy  = &pos[i];
+        Point *vxy = &vel[i];
+
+        xy->x += vxy->x * FRAME_DELTA;
+        xy->y += vxy->y * FRAME_DELTA;
+
+        if (xy->x < 0)      vxy->x =  fabsf(vxy->x);
+        if (xy->x > width)  vxy->x = -fabsf(vxy->x);
+
+        if (xy->y < 0)      vxy->y =  fabsf(vxy->y);
+        if (xy->y > height) vxy->y = -fabsf(vxy->y);
+    }
+}
+
+#endif // BACKENDS_IMPLEMENTATION_
+
+#endif // BACKENDS_IMPLEMENTATION
@@ -0,0 +1,597 @@
+//
+// bench.c - headless benchmark for the CPU backends
+//
+// every backend is compiled with its own prefix (see voronoi_compute.h)
+// so they can all be linked into this one binary, and none of
+// them need a window. results are written out as CSV.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "common.h"
+
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
+
+#define THREAD_POOL_IMPLEMENTATION
+#include "thread_pool.h"
+
+#define TRAJECTORY_IMPLEMENTATION
+#include "trajectory.h"
+
+#define BACKENDS_IMPLEMENTATION
+#include "backends.h"
+
+#include "voronoi_compute.h"
+
+
+typedef struct Resolution {
+    u64 width, height;
+} Resolution;
+
+Resolution resolutions[] = {
+    { 640,  360},
+    {1280,  720},
+    {1920, 1080},
+    {3840, 2160},
+    {7680, 4320},
+};
+#define NUM_RESOLUTIONS (sizeof(resolutions) / sizeof(resolutions[0]))
+
+u64 point_counts[] = {10, 100, 1000, 10000, 100000, 1000000};
+#define NUM_POINT_COUNTS (sizeof(point_counts) / sizeof(point_counts[0]))
+
+typedef enum Distribution {
+    DIST_UNIFORM,
+    DIST_CLUSTERED,
+    DIST_COLLINEAR,
+    NUM_DISTRIBUTIONS,
+} Distribution;
+
+const char *distribution_names[NUM_DISTRIBUTIONS] = {
+    [DIST_UNIFORM]   = "uniform",
+    [DIST_CLUSTERED] = "clustered",
+    [DIST_COLLINEAR] = "collinear",
+};
+
+
+typedef enum Motion {
+    // every point moves every frame
+    MOTION_WALK,
+    // the same points every frame, like main.c when its paused
+    MOTION_PAUSED,
+    // they move, and every other frame the last tenth of them is gone
+    MOTION_CHURN,
+    NUM_MOTIONS,
+} Motion;
+
+const char *motion_names[NUM_MOTIONS] = {
+    [MOTION_WALK]   = "walk",
+    [MOTION_PAUSED] = "paused",
+    [MOTION_CHURN]  = "churn",
+};
+
+
+#define NUM_CLUSTERS 16
+
+#define PI 3.14159265358979323846f
+
+
+// standard normal, Box-Muller
+float rng_normal(void) {
+    float u1 = rng_float();
+    float u2 = rng_float();
+    if (u1 < 1e-7f) u1 = 1e-7f;
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * PI * u2);
+}
+
+float clampf(float x, float low, float high) {
+    if (x < low)  return low;
+    if (x > high) return high;
+    return x;
+}
+
+
+typedef struct Scene {
+    Point *pos;
+    Point *vel;
+    u64 count;
+    u64 width, height;
+} Scene;
+
+void make_scene(Scene *scene, Distribution dist, u64 num_points, u64 width, u64 height, u64 seed) {
+    rng_state = seed;
+
+    scene->pos = realloc(scene->pos, num_points * sizeof(Point));
+    scene->vel = realloc(scene->vel, num_points * sizeof(Point));
+    assert(scene->pos && scene->vel && "Buy More RAM lol");
+
+    scene->count  = num_points;
+    scene->width  = width;
+    scene->height = height;
+
+    Point centers[NUM_CLUSTERS];
+    for (u64 i = 0; i < NUM_CLUSTERS; i++) {
+        centers[i] = (Point){rng_float() * width, rng_float() * height};
+    }
+    float sigma = 0.03f * (width < height ? width : height);
+
+    for (u64 i = 0; i < num_points; i++) {
+        Point pos;
+        switch (dist) {
+            case DIST_UNIFORM: {
+                pos = (Point){rng_float() * width, rng_float() * height};
+            } break;
+
+            case DIST_CLUSTERED: {
+                Point center = centers[rng_next() % NUM_CLUSTERS];
+                pos.x = clampf(center.x + rng_normal() * sigma, 0, width  - 1);
+                pos.y = clampf(center.y + rng_normal() * sigma, 0, height - 1);
+            } break;
+
+            case DIST_COLLINEAR: {
+                // all on the one line, the worst case for the geometric backends.
+                pos = (Point){rng_float() * width, height / 2.0f};
+            } break;
+
+            default: assert(false && "Unreachable");
+        }
+
+        Point vel = random_velocity();
+        // keep them on the line.
+        if (dist == DIST_COLLINEAR) vel.y = 0;
+
+        scene->pos[i] = pos;
+        scene->vel[i] = vel;
+    }
+}
+
+// the points of the next frame go in 'frame', (it shares the points with 'scene')
+void move_scene(Scene *scene, Scene *frame, Motion motion, u64 frame_index) {
+    if (motion != MOTION_PAUSED) walk_points(scene->pos, scene->vel, 0, scene->count, scene->width, scene->height);
+
+    *frame = *scene;
+    if (motion == MOTION_CHURN && frame_index % 2) frame->count -= frame->count / 10;
+}
+
+void free_scene(Scene *scene) {
+    free(scene->pos);
+    free(scene->vel);
+    *scene = (Scene){0};
+}
+
+
+typedef struct Error_Stats {
+    // the fraction of pixels that got a point further away than the closest one
+    double error_rate;
+    // the most any pixel was off by, in pixels
+    double max_error;
+} Error_Stats;
+
+// the most points*pixels check_labels() goes through, about a second.
+// above this only every so many pixels get checked.
+#define CHECK_BUDGET 1000000000ull
+
+// the closest point to the pixel (x, y), by trying all of them. ties go to the lowest index.
+// no grid, no cells, nothing the backends use, so it cant be wrong the same way they are.
+u32 brute_force_nearest(const Point *pos, u64 count, float x, float y) {
+    u32 best = VORONOI_NO_LABEL;
+    float best_d = INFINITY;
+    for (u64 k = 0; k < count; k++) {
+        // the same math as seed_soa_nearest()
+        float d = (pos[k].x-x)*(pos[k].x-x) + (pos[k].y-y)*(pos[k].y-y);
+        if (d < best_d) {
+            best_d = d;
+            best = k;
+        }
+    }
+    return best;
+}
+
+// how far off 'labels' is from the brute force.
+// pixels that got no point at all are counted as wrong, with no distance.
+// a pixel that went to another point just as close is right.
+Error_Stats check_labels(const u32 *labels, Scene *scene) {
+    u64 num_pixels = scene->width * scene->height;
+    if (scene->count == 0 || num_pixels == 0) return (Error_Stats){0};
+
+    // odd, so it doesnt land on the same columns every row
+    u64 step = 1;
+    if (num_pixels * scene->count > CHECK_BUDGET) step = (num_pixels * scene->count / CHECK_BUDGET) | 1;
+
+    u64 wrong = 0, checked = 0;
+    double max_error = 0;
+
+    for (u64 k = 0; k < num_pixels; k += step) {
+        u64 i = k % scene->width;
+        u64 j = k / scene->width;
+        checked += 1;
+
+        u32 label = labels[k];
+        if (label >= scene->count) {
+            wrong += 1;
+            continue;
+        }
+
+        u32 right = brute_force_nearest(scene->pos, scene->count, i, j);
+        if (label == right) continue;
+
+        Point p = scene->pos[label];
+        Point q = scene->pos[right];
+        float d_label = (p.x-i)*(p.x-i) + (p.y-j)*(p.y-j);
+        float d_right = (q.x-i)*(q.x-i) + (q.y-j)*(q.y-j);
+        if (d_label <= d_right) continue;
+
+        wrong += 1;
+        double error = sqrt(d_label) - sqrt(d_right);
+        if (max_error < error) max_error = error;
+    }
+
+    return (Error_Stats){
+        .error_rate = (double) wrong / checked,
+        .max_error  = max_error,
+    };
+}
+
+
+Error_Stats worse_errors(Error_Stats a, Error_Stats b) {
+    return (Error_Stats){
+        .error_rate = a.error_rate > b.error_rate ? a.error_rate : b.error_rate,
+        .max_error  = a.max_error  > b.max_error  ? a.max_error  : b.max_error,
+    };
+}
+
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank, 'times' must be sorted
+double percentile(double *times, u64 count, double p) {
+    u64 rank = (u64) ceil(p * count);
+    if (rank < 1)     rank = 1;
+    if (rank > count) rank = count;
+    return times[rank - 1];
+}
+
+
+// every backend on the frames of a recording, (main_* --record FILE) one CSV row each.
+// its width, height and num_points are the biggest any frame had.
+// false if the recording has no frames.
+bool bench_replay(FILE *out, Trajectory *trajectory, const char *only_backend, bool check) {
+    // how big the buffers have to be
+    u64 max_width = 0, max_height = 0, max_pixels = 0, max_points = 0;
+    u64 num_frames = 0;
+
+    Trajectory_Frame frame;
+    trajectory_rewind(trajectory);
+    while (trajectory_next(trajectory, &frame)) {
+        if (max_width  < frame.width)  max_width  = frame.width;
+        if (max_height < frame.height) max_height = frame.height;
+        if (max_pixels < (u64) frame.width * frame.height) max_pixels = (u64) frame.width * frame.height;
+        if (max_points < frame.num_points) max_points = frame.num_points;
+        num_frames += 1;
+    }
+    if (num_frames == 0) return false;
+
+    u32 *labels   = malloc(max_pixels * sizeof(u32));
+    double *times = malloc(num_frames * sizeof(double));
+    assert(labels && times && "Buy More RAM lol");
+
+    for (u64 b = 0; b < NUM_BACKENDS; b++) {
+        Backend backend = backends[b];
+        if (only_backend && strcmp(only_backend, backend.name) != 0) continue;
+
+        backend.init();
+        pool_reset_stats();
+
+        u64 frames_done = 0;
+        double total = 0;
+        u64 total_pixels = 0, total_points = 0;
+        Error_Stats errors = {0};
+
+        // no budget, every frame is run. (its the same frames for everyone)
+        trajectory_rewind(trajectory);
+        while (trajectory_next(trajectory, &frame)) {
+            time_unit start = get_time();
+            PROFILER_ZONE("compute");
+                backend.compute(labels, frame.width, frame.height, frame.points, frame.num_points);
+                PROFILER_ZONE_ITEMS((u64) frame.width * frame.height);
+            PROFILER_ZONE_END();
+            time_unit end = get_time();
+
+            double secs = elapsed_time_in_secs(start, end);
+            times[frames_done++] = secs;
+            total += secs;
+            total_pixels += (u64) frame.width * frame.height;
+            total_points += frame.num_points;
+
+            // the first and the last frame, (not part of the time)
+            if ((frames_done == 1 || frames_done == num_frames) && check) {
+                Scene scene = {
+                    .pos    = (Point *) frame.points,
+                    .count  = frame.num_points,
+                    .width  = frame.width,
+                    .height = frame.height,
+                };
+                errors = worse_errors(errors, check_labels(labels, &scene));
+            }
+        }
+
+        double mean = total / frames_done;
+        qsort(times, frames_done, sizeof(double), compare_doubles);
+
+        fprintf(out, "%s,replay,recorded,%zu,%zu,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,",
+                backend.name, max_width, max_height, max_points, frames_done,
+                mean * 1e3,
+                percentile(times, frames_done, 0.50) * 1e3,
+                percentile(times, frames_done, 0.90) * 1e3,
+                percentile(times, frames_done, 0.99) * 1e3,
+                times[frames_done - 1] * 1e3,
+                total_pixels ? total * 1e9 / total_pixels : 0,
+                total_points ? total * 1e9 / total_points : 0);
+        if (check) {
+            fprintf(out, "%.6f,%.3f\n", errors.error_rate, errors.max_error);
+        } else {
+            fprintf(out, ",\n");
+        }
+        fflush(out);
+
+        fprintf(stderr, "%-16s replay     recorded %5zux%-5zu %8zu points: %10.3f ms",
+                backend.name, max_width, max_height, max_points, mean * 1e3);
+        if (check) fprintf(stderr, ", %.4f%% wrong", errors.error_rate * 100);
+        fprintf(stderr, "\n");
+
+        if (pool_get_stats().jobs) pool_print_stats(stderr);
+
+        backend.finish();
+    }
+
+    free(labels);
+    free(times);
+    return true;
+}
+
+
+void usage(FILE *stream, const char *program) {
+    fprintf(stream, "USAGE: %s [OPTIONS]\n", program);
+    fprintf(stream, "    --out FILE           write the CSV here (default: stdout)\n");
+    fprintf(stream, "    --backend NAME       only run this backend (default: all)\n");
+    fprintf(stream, "    --distribution NAME  uniform, clustered or collinear (default: all)\n");
+    fprintf(stream, "    --motion NAME        walk, paused or churn (default: all)\n");
+    fprintf(stream, "    --frames N           frames per configuration (default: 30)\n");
+    fprintf(stream, "    --max-points N       skip point counts above N\n");
+    fprintf(stream, "    --budget SECS        time budget per configuration (default: 2)\n");
+    fprintf(stream, "    --seed S             random seed (default: 1)\n");
+    fprintf(stream, "    --threads N          threads for the threaded backends (default: one per core)\n");
+    fprintf(stream, "    --no-check           dont check the first and last frames against the brute force\n");
+    fprintf(stream, "    --trace FILE         write the profiler zones to FILE, as a Chrome trace\n");
+    fprintf(stream, "    --replay FILE        run every frame of a recording (main_* --record FILE) instead\n");
+}
+
+
+int main(int argc, char const **argv) {
+    const char *program = argv[0];
+
+    const char *out_path     = NULL;
+    const char *only_backend = NULL;
+    const char *only_dist    = NULL;
+    const char *only_motion  = NULL;
+    const char *trace_path   = NULL;
+    const char *replay_path  = NULL;
+    u64 num_frames = 30;
+    u64 max_points = (u64) -1;
+    double budget  = 2.0;
+    u64 seed       = 1;
+    bool check     = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            usage(stdout, program);
+            return 0;
+        }
+        if (strcmp(arg, "--no-check") == 0) {
+            check = false;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "ERROR: '%s' needs an argument, or is unknown\n", arg);
+            usage(stderr, program);
+            return 1;
+        }
+        const char *value = argv[++i];
+
+        if      (strcmp(arg, "--out")          == 0) out_path     = value;
+        else if (strcmp(arg, "--backend")      == 0) only_backend = value;
+        else if (strcmp(arg, "--distribution") == 0) only_dist    = value;
+        else if (strcmp(arg, "--motion")       == 0) only_motion  = value;
+        else if (strcmp(arg, "--frames")       == 0) num_frames   = atol(value);
+        else if (strcmp(arg, "--max-points")   == 0) max_points   = atol(value);
+        else if (strcmp(arg, "--budget")       == 0) budget       = atof(value);
+        else if (strcmp(arg, "--seed")         == 0) seed         = atol(value);
+        else if (strcmp(arg, "--trace")        == 0) trace_path   = value;
+        else if (strcmp(arg, "--replay")       == 0) replay_path  = value;
+        // pool_start() reads this
+        else if (strcmp(arg, "--threads")      == 0) setenv("VORONOI_THREADS", value, 1);
+        else {
+            fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+            usage(stderr, program);
+            return 1;
+        }
+    }
+
+    if (num_frames == 0) num_frames = 1;
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            fprintf(stderr, "ERROR: could not open '%s'\n", out_path);
+            return 1;
+        }
+    }
+
+
+    // enough for the biggest resolution
+    u64 max_pixels = 0;
+    for (u64 i = 0; i < NUM_RESOLUTIONS; i++) {
+        u64 pixels = resolutions[i].width * resolutions[i].height;
+        if (max_pixels < pixels) max_pixels = pixels;
+    }
+    u32 *labels   = malloc(max_pixels * sizeof(u32));
+    double *times = malloc(num_frames * sizeof(double));
+    assert(labels && times && "Buy More RAM lol");
+
+    PROFILER_NAME_THREAD("main thread");
+    if (trace_path) {
+        if (!profiler_trace_start(trace_path)) {
+            fprintf(stderr, "ERROR: could not open '%s'\n", trace_path);
+            return 1;
+        }
+    }
+
+    // every backend shares these threads.
+    pool_start();
+
+    Scene scene = {0};
+
+    fprintf(out, "backend,distribution,motion,width,height,num_points,frames,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,ns_per_pixel,ns_per_seed,error_rate,max_error_px\n");
+
+    int exit_code = 0;
+    if (replay_path) {
+        Trajectory trajectory;
+        if (!trajectory_open(&trajectory, replay_path)) {
+            exit_code = 1;
+        } else {
+            if (!bench_replay(out, &trajectory, only_backend, check)) {
+                fprintf(stderr, "ERROR: '%s' has no frames\n", replay_path);
+                exit_code = 1;
+            }
+            trajectory_close(&trajectory);
+        }
+    }
+
+    // (a replay is instead of these)
+    for (u64 b = 0; !replay_path && b < NUM_BACKENDS; b++) {
+        Backend backend = backends[b];
+        if (only_backend && strcmp(only_backend, backend.name) != 0) continue;
+
+        backend.init();
+        pool_reset_stats();
+
+        for (u64 d = 0; d < NUM_DISTRIBUTIONS; d++) {
+            if (only_dist && strcmp(only_dist, distribution_names[d]) != 0) continue;
+
+            for (u64 m = 0; m < NUM_MOTIONS; m++) {
+                if (only_motion && strcmp(only_motion, motion_names[m]) != 0) continue;
+
+                for (u64 r = 0; r < NUM_RESOLUTIONS; r++) {
+                    Resolution res = resolutions[r];
+
+                    double last_mean = 0, prev_mean = 0;
+                    u64 last_count = 0, prev_count = 0;
+
+                    for (u64 c = 0; c < NUM_POINT_COUNTS; c++) {
+                        u64 num_points = point_counts[c];
+                        if (num_points > max_points) break;
+
+                        // guess how the cost grows with the number of points from the last two runs,
+                        // and dont start anything that would blow the budget on its own.
+                        double growth = 0;
+                        if (prev_count && prev_mean > 0 && last_mean > 0) {
+                            growth = log(last_mean / prev_mean) / log((double) last_count / prev_count);
+                            if (growth < 0) growth = 0;
+                        }
+                        if (prev_count && last_mean * pow((double) num_points / last_count, growth) > budget) {
+                            fprintf(stderr, "%-16s %-10s %-6s %5zux%-5zu %8zu points: skipped, over budget\n",
+                                    backend.name, distribution_names[d], motion_names[m], res.width, res.height, num_points);
+                            break;
+                        }
+
+                        make_scene(&scene, d, num_points, res.width, res.height, seed);
+                        // the points of the frame thats in 'labels'
+                        Scene frame = scene;
+
+                        u64 frames_done = 0;
+                        double total = 0;
+                        Error_Stats errors = {0};
+                        while (frames_done < num_frames && total < budget) {
+                            if (frames_done > 0) move_scene(&scene, &frame, m, frames_done);
+
+                            time_unit start = get_time();
+                            PROFILER_ZONE("compute");
+                                backend.compute(labels, res.width, res.height, (float *) frame.pos, frame.count);
+                                PROFILER_ZONE_ITEMS(res.width * res.height);
+                            PROFILER_ZONE_END();
+                            time_unit end = get_time();
+
+                            double secs = elapsed_time_in_secs(start, end);
+                            times[frames_done++] = secs;
+                            total += secs;
+
+                            // the first frame is from scratch, the rest are what the backends
+                            // that keep things between frames have to get right. (not part of the time)
+                            if (frames_done == 1 && check) errors = check_labels(labels, &frame);
+                        }
+                        if (frames_done > 1 && check) errors = worse_errors(errors, check_labels(labels, &frame));
+
+                        double mean = total / frames_done;
+                        qsort(times, frames_done, sizeof(double), compare_doubles);
+
+                        fprintf(out, "%s,%s,%s,%zu,%zu,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,",
+                                backend.name, distribution_names[d], motion_names[m], res.width, res.height, num_points, frames_done,
+                                mean * 1e3,
+                                percentile(times, frames_done, 0.50) * 1e3,
+                                percentile(times, frames_done, 0.90) * 1e3,
+                                percentile(times, frames_done, 0.99) * 1e3,
+                                times[frames_done - 1] * 1e3,
+                                mean * 1e9 / (res.width * res.height),
+                                mean * 1e9 / num_points);
+                        if (check) {
+                            fprintf(out, "%.6f,%.3f\n", errors.error_rate, errors.max_error);
+                        } else {
+                            fprintf(out, ",\n");
+                        }
+                        fflush(out);
+
+                        fprintf(stderr, "%-16s %-10s %-6s %5zux%-5zu %8zu points: %10.3f ms",
+                                backend.name, distribution_names[d], motion_names[m], res.width, res.height, num_points, mean * 1e3);
+                        if (check) fprintf(stderr, ", %.4f%% wrong", errors.error_rate * 100);
+                        fprintf(stderr, "\n");
+
+                        prev_mean  = last_mean;
+                        prev_count = last_count;
+                        last_mean  = mean;
+                        last_count = num_points;
+                    }
+                }
+            }
+        }
+
+        // how long it takes to wake the threads, and how well the work was spread out.
+        if (pool_get_stats().jobs) pool_print_stats(stderr);
+
+        backend.finish();
+    }
+
+    free_scene(&scene);
+    pool_stop();
+
+    free(labels);
+    free(times);
+
+    if (out != stdout) fclose(out);
+
+    // (this writes the rest of the trace)
+    PROFILER_FREE();
+    return exit_code;
+}
@@ -25,6 +25,17 @@
     } while (0)
 
 
+// room for at least 'n' items, without adding any
+#define da_reserve(da, n)                                                                                  \
+    do {                                                                                                   \
+        if ((da)->capacity < (n)) {                                                                        \
+            (da)->capacity = (n);                                                                          \
+            (da)->items = (typeof((da)->items)) realloc((da)->items, (da)->capacity*sizeof(*(da)->items)); \
+            assert((da)->items != NULL && "Buy More RAM lol");                                             \
+        }                                                                                                  \
+    } while (0)
+
+
 #define da_stamp_and_remove(da, index)                      \
     do {                                                    \
         (da)->items[(index)] = (da)->items[(da)->count-1];  \
@@ -0,0 +1,401 @@
+//
+// frame_writer.h - write label maps out as images, on their own thread
+//
+// there are two label buffers. the caller computes a frame into one, hands
+// it over, and gets on with the next one in the other, while the writer
+// thread turns the first into colors, encodes it and writes it out. the
+// caller only waits when the writer is a whole frame behind.
+//
+// the images are either PPM, (P6, no compression, anything can read it)
+// or QOI, (https://qoiformat.org) which is mostly runs for a voronoi,
+// so its small and about as fast to write.
+//
+// #define FRAME_WRITER_IMPLEMENTATION in exactly one file. (render.c)
+//
+
+#ifndef FRAME_WRITER_H_
+#define FRAME_WRITER_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ints.h"
+
+// one frame being computed, one being written
+#define FRAME_WRITER_SLOTS 2
+
+// the same layout as a raylib Color
+typedef struct Frame_Color {
+    u8 r, g, b, a;
+} Frame_Color;
+
+typedef enum Frame_Format {
+    FRAME_FORMAT_PPM,
+    FRAME_FORMAT_QOI,
+    NUM_FRAME_FORMATS,
+} Frame_Format;
+
+// also the file extensions
+static const char *const frame_format_names[NUM_FRAME_FORMATS] = {
+    [FRAME_FORMAT_PPM] = "ppm",
+    [FRAME_FORMAT_QOI] = "qoi",
+};
+
+typedef struct Frame_Slot {
+    u32 *labels;
+    u64 frame;
+
+    // a copy, so the caller can change theirs
+    Frame_Color *colors;
+    u64 num_colors;
+    u64 colors_capacity;
+
+    // waiting for the writer
+    bool full;
+} Frame_Slot;
+
+typedef struct Frame_Writer {
+    const char *dir;
+    Frame_Format format;
+    u64 width, height;
+
+    Frame_Slot slots[FRAME_WRITER_SLOTS];
+    // the next one for the caller, and the next one for the writer
+    u64 next_fill;
+    u64 next_write;
+
+    // the writers, the encoded image goes here before its written
+    u8 *encoded;
+    u64 encoded_capacity;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool stopping;
+
+    // the errno of the first write that failed, 0 if none did
+    int error;
+    u64 frames_written;
+    u64 bytes_written;
+} Frame_Writer;
+
+
+// frames go to 'dir'/frame_000000.ppm and so on, 'dir' has to be there already.
+void frame_writer_start(Frame_Writer *writer, const char *dir, Frame_Format format, u64 width, u64 height);
+
+// a width*height buffer to compute the next frame into, waits if the writer is behind.
+u32 *frame_writer_begin(Frame_Writer *writer);
+// hands the buffer from frame_writer_begin() to the writer, the labels index 'colors'.
+// labels past 'num_colors' (like VORONOI_NO_LABEL) come out magenta.
+void frame_writer_end(Frame_Writer *writer, u64 frame, const Frame_Color *colors, u64 num_colors);
+
+// 0, or the errno of the first frame that couldnt be written.
+int frame_writer_error(Frame_Writer *writer);
+// writes everything thats left, and frees it all. returns the same as frame_writer_error()
+int frame_writer_stop(Frame_Writer *writer);
+
+#endif // FRAME_WRITER_H_
+
+
+#ifdef FRAME_WRITER_IMPLEMENTATION
+
+#ifndef FRAME_WRITER_IMPLEMENTATION_
+#define FRAME_WRITER_IMPLEMENTATION_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "profiler.h"
+
+// what the window clears to, so it looks the same
+#define FRAME_NO_LABEL_COLOR ((Frame_Color){255, 0, 255, 255})
+
+
+static Frame_Color frame_color(const Frame_Slot *slot, u32 label) {
+    if (label < slot->num_colors) return slot->colors[label];
+    return FRAME_NO_LABEL_COLOR;
+}
+
+static void frame_writer_reserve(Frame_Writer *writer, u64 size) {
+    if (writer->encoded_capacity >= size) return;
+    writer->encoded_capacity = size;
+    free(writer->encoded);
+    writer->encoded = malloc(size);
+    assert(writer->encoded != NULL && "Buy More RAM lol");
+}
+
+static u64 frame_encode_ppm(Frame_Writer *writer, const Frame_Slot *slot) {
+    char header[64];
+    int header_size = snprintf(header, sizeof(header), "P6\n%zu %zu\n255\n", writer->width, writer->height);
+
+    u64 num_pixels = writer->width * writer->height;
+    frame_writer_reserve(writer, header_size + 3*num_pixels);
+
+    u8 *out = writer->encoded;
+    memcpy(out, header, header_size);
+    out += header_size;
+
+    // the colors only change where the labels do
+    u32 last_label = slot->labels[0];
+    Frame_Color color = frame_color(slot, last_label);
+    for (u64 i = 0; i < num_pixels; i++) {
+        u32 label = slot->labels[i];
+        if (label != last_label) {
+            color = frame_color(slot, label);
+            last_label = label;
+        }
+        *out++ = color.r;
+        *out++ = color.g;
+        *out++ = color.b;
+    }
+
+    return out - writer->encoded;
+}
+
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+
+#define QOI_MAX_RUN  62
+
+static void frame_put_u32_be(u8 *out, u32 x) {
+    out[0] = x >> 24;
+    out[1] = x >> 16;
+    out[2] = x >>  8;
+    out[3] = x >>  0;
+}
+
+static u64 frame_encode_qoi(Frame_Writer *writer, const Frame_Slot *slot) {
+    static const u8 padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+    u64 num_pixels = writer->width * writer->height;
+    // the worst case is a QOI_OP_RGB for every pixel
+    frame_writer_reserve(writer, 14 + 4*num_pixels + sizeof(padding));
+
+    u8 *out = writer->encoded;
+    memcpy(out, "qoif", 4);
+    frame_put_u32_be(out + 4, writer->width);
+    frame_put_u32_be(out + 8, writer->height);
+    out[12] = 3; // RGB
+    out[13] = 0; // sRGB, linear alpha
+    out += 14;
+
+    Frame_Color index[64] = {0};
+    Frame_Color prev = {0, 0, 0, 255};
+    u32 prev_label = 0;
+    u64 run = 0;
+
+    for (u64 i = 0; i < num_pixels; i++) {
+        u32 label = slot->labels[i];
+
+        // a voronoi is mostly the same label as the last pixel, and thats
+        // the same color, so those dont need to look at the color at all.
+        if (i > 0 && label == prev_label) {
+            run += 1;
+            if (run == QOI_MAX_RUN) {
+                *out++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        prev_label = label;
+        Frame_Color color = frame_color(slot, label);
+
+        if (color.r == prev.r && color.g == prev.g && color.b == prev.b) {
+            run += 1;
+            if (run == QOI_MAX_RUN) {
+                *out++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            *out++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        u8 hash = (color.r*3 + color.g*5 + color.b*7 + 255*11) % 64;
+        Frame_Color seen = index[hash];
+        if (seen.r == color.r && seen.g == color.g && seen.b == color.b && seen.a == 255) {
+            *out++ = QOI_OP_INDEX | hash;
+        } else {
+            index[hash] = (Frame_Color){color.r, color.g, color.b, 255};
+
+            s8 dr = color.r - prev.r;
+            s8 dg = color.g - prev.g;
+            s8 db = color.b - prev.b;
+            s8 dr_dg = dr - dg;
+            s8 db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                *out++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                *out++ = QOI_OP_LUMA | (dg + 32);
+                *out++ = (dr_dg + 8) << 4 | (db_dg + 8);
+            } else {
+                *out++ = QOI_OP_RGB;
+                *out++ = color.r;
+                *out++ = color.g;
+                *out++ = color.b;
+            }
+        }
+
+        prev = (Frame_Color){color.r, color.g, color.b, 255};
+    }
+    if (run > 0) *out++ = QOI_OP_RUN | (run - 1);
+
+    memcpy(out, padding, sizeof(padding));
+    out += sizeof(padding);
+
+    return out - writer->encoded;
+}
+
+
+static int frame_write_file(Frame_Writer *writer, u64 frame, u64 size) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/frame_%06zu.%s", writer->dir, frame, frame_format_names[writer->format]);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return errno;
+
+    int error = 0;
+    if (fwrite(writer->encoded, 1, size, file) != size) error = errno ? errno : EIO;
+    if (fclose(file) != 0 && !error) error = errno;
+    return error;
+}
+
+static void *frame_writer_thread(void *data) {
+    Frame_Writer *writer = data;
+    PROFILER_NAME_THREAD("frame writer");
+
+    while (true) {
+        pthread_mutex_lock(&writer->lock);
+        Frame_Slot *slot = &writer->slots[writer->next_write];
+        while (!slot->full && !writer->stopping) pthread_cond_wait(&writer->changed, &writer->lock);
+        // everything thats been handed over is written before stopping
+        bool done = !slot->full;
+        pthread_mutex_unlock(&writer->lock);
+        if (done) break;
+
+        // after the first error, the rest are only thrown away
+        if (!writer->error) {
+            PROFILER_ZONE("encode frame");
+                u64 size = writer->format == FRAME_FORMAT_QOI ? frame_encode_qoi(writer, slot) : frame_encode_ppm(writer, slot);
+                PROFILER_ZONE_ITEMS(writer->width * writer->height);
+            PROFILER_ZONE_END();
+
+            PROFILER_ZONE("write frame");
+                int error = frame_write_file(writer, slot->frame, size);
+            PROFILER_ZONE_END();
+
+            pthread_mutex_lock(&writer->lock);
+            if (error) {
+                writer->error = error;
+            } else {
+                writer->frames_written += 1;
+                writer->bytes_written  += size;
+            }
+            pthread_mutex_unlock(&writer->lock);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        slot->full = false;
+        writer->next_write = (writer->next_write + 1) % FRAME_WRITER_SLOTS;
+        pthread_cond_broadcast(&writer->changed);
+        pthread_mutex_unlock(&writer->lock);
+    }
+
+    return NULL;
+}
+
+
+void frame_writer_start(Frame_Writer *writer, const char *dir, Frame_Format format, u64 width, u64 height) {
+    *writer = (Frame_Writer){
+        .dir    = dir,
+        .format = format,
+        .width  = width,
+        .height = height,
+    };
+
+    for (u64 i = 0; i < FRAME_WRITER_SLOTS; i++) {
+        writer->slots[i].labels = malloc(width * height * sizeof(u32));
+        assert(writer->slots[i].labels != NULL && "Buy More RAM lol");
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+
+    int error = pthread_create(&writer->thread, NULL, frame_writer_thread, writer);
+    assert(error == 0 && "could not start the frame writer thread");
+    (void) error;
+}
+
+u32 *frame_writer_begin(Frame_Writer *writer) {
+    PROFILER_ZONE("wait for writer");
+        pthread_mutex_lock(&writer->lock);
+        Frame_Slot *slot = &writer->slots[writer->next_fill];
+        while (slot->full) pthread_cond_wait(&writer->changed, &writer->lock);
+        pthread_mutex_unlock(&writer->lock);
+    PROFILER_ZONE_END();
+
+    return slot->labels;
+}
+
+void frame_writer_end(Frame_Writer *writer, u64 frame, const Frame_Color *colors, u64 num_colors) {
+    // the writer doesnt touch a slot thats not full, so no lock for this part.
+    Frame_Slot *slot = &writer->slots[writer->next_fill];
+    slot->frame = frame;
+
+    if (slot->colors_capacity < num_colors) {
+        slot->colors_capacity = num_colors;
+        free(slot->colors);
+        slot->colors = malloc(num_colors * sizeof(Frame_Color));
+        assert(slot->colors != NULL && "Buy More RAM lol");
+    }
+    if (num_colors) memcpy(slot->colors, colors, num_colors * sizeof(Frame_Color));
+    slot->num_colors = num_colors;
+
+    pthread_mutex_lock(&writer->lock);
+    slot->full = true;
+    writer->next_fill = (writer->next_fill + 1) % FRAME_WRITER_SLOTS;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+int frame_writer_error(Frame_Writer *writer) {
+    pthread_mutex_lock(&writer->lock);
+    int error = writer->error;
+    pthread_mutex_unlock(&writer->lock);
+    return error;
+}
+
+int frame_writer_stop(Frame_Writer *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+
+    for (u64 i = 0; i < FRAME_WRITER_SLOTS; i++) {
+        free(writer->slots[i].labels);
+        free(writer->slots[i].colors);
+    }
+    free(writer->encoded);
+
+    return writer->error;
+}
+
+#endif // FRAME_WRITER_IMPLEMENTATION_
+
+#endif // FRAME_WRITER_IMPLEMENTATION
@@ -1,5 +1,7 @@
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "raylib.h"
 #include "raymath.h"
@@ -9,11 +11,23 @@
 #define PROFILER_IMPLEMENTATION
 #include "profiler.h"
 
+#define THREAD_POOL_IMPLEMENTATION
+#include "thread_pool.h"
+
+#define TRAJECTORY_IMPLEMENTATION
+#include "trajectory.h"
+
+#define SEED_FILE_IMPLEMENTATION
+#include "seed_file.h"
+
 #include "voronoi.h"
 
 
 #define FONT_SIZE 20
 
+// 'T' starts and stops writing one of these, (open it in chrome://tracing or ui.perfetto.dev)
+#define TRACE_PATH "voronoi_trace.json"
+
 // in pixels per second
 #define SPEED 100
 
@@ -21,44 +35,97 @@ int screen_width  = 1600;
 int screen_height =  900;
 
 
-void draw_profiler(void) {
-    // TODO this is inefficient...
-    Profiler_Stats_Array stats = collect_stats();
+// the last PROFILER_RECENT times of a zone, one pixel wide bar each, (oldest on the left)
+// as tall as the line is for a whole frame, red ones went over.
+void draw_sparkline(const Profiler_Stats *stat, int x, int y) {
+    double recent[PROFILER_RECENT];
+    size_t num_recent = profiler_stats_recent(stat, recent);
+    double budget = profiler_get_budget();
+
+    int height = FONT_SIZE - 2;
+    DrawRectangle(x, y, PROFILER_RECENT, height, (Color){40, 40, 40, 200});
+    for (size_t i = 0; i < num_recent; i++) {
+        double fraction = recent[i] / budget;
+        int bar = fraction >= 1 ? height : (int) (fraction * height + 0.5);
+        if (bar < 1) bar = 1;
+        DrawRectangle(x + PROFILER_RECENT - num_recent + i, y + height - bar, 1, bar, fraction >= 1 ? RED : GREEN);
+    }
+}
 
-    int numbers_width = MeasureText(": 0.000000 +- 0.000000", FONT_SIZE);
+void draw_profiler(void) {
+    // the profiler keeps these up to date as it goes, nothing to add up here.
+    // (the pool threads are all waiting by now, so their zones can be read too)
+    Profiler_Stats_Array stats = profiler_stats();
+
+    // all in milliseconds, the percentiles come from the zone's histogram,
+    // and 'miss' is how many times it took longer than a frame.
+    int numbers_width = MeasureText(": 00.000 +- 00.000  p50 00.000  p95 00.000  p99 00.000  max 00.000  miss 0000", FONT_SIZE);
+    // with PROFILER_COUNTERS, the instructions per cycle, and the misses per pixel
+    bool counters = profiler_counters_available() != 0;
+    if (counters) numbers_width += MeasureText("  ipc 0.00  l1 0.000  llc 0.000  br 0.000 /px", FONT_SIZE);
+    int indent_width  = MeasureText("  ", FONT_SIZE);
 
     int max_title_text_width = 0;
     for (size_t i = 0; i < stats.count; i++) {
-        Profiler_Stats stat = stats.items[i];
-        int title_text_width = MeasureText(stat.title, FONT_SIZE);
+        Profiler_Stats *stat = stats.items[i];
+        int title_text_width = MeasureText(stat->title, FONT_SIZE) + stat->depth*indent_width;
+        if (max_title_text_width < title_text_width) {
+            max_title_text_width = title_text_width;
+        }
+
+        title_text_width = MeasureText(stat->thread_name, FONT_SIZE);
         if (max_title_text_width < title_text_width) {
             max_title_text_width = title_text_width;
         }
     }
 
+    int y = 10;
+    size_t last_thread = PROFILER_NONE;
     for (size_t i = 0; i < stats.count; i++) {
-        Profiler_Stats stat = stats.items[i];
-
-        Numerical_Average_Bounds nab = get_numerical_average(stat.times);
+        Profiler_Stats *stat = stats.items[i];
+
+        // a heading for every thread
+        if (stat->thread != last_thread) {
+            last_thread = stat->thread;
+            DrawText(stat->thread_name,
+                    screen_width - numbers_width - 10 - max_title_text_width - 10,
+                    y,
+                    FONT_SIZE, YELLOW);
+            y += FONT_SIZE;
+        }
 
-        const char *title_text = TextFormat("%-30s", stat.title, nab.sample_mean, nab.standard_deviation);
-        const char *numbers_text = TextFormat(": %.6f +- %.6f", nab.sample_mean, nab.standard_deviation);
+        const char *title_text = TextFormat("%-30s", stat->title);
+        char numbers_text[256];
+        int n = snprintf(numbers_text, sizeof(numbers_text), ": %.3f +- %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f  miss %zu",
+                         stat->mean*1e3, profiler_stats_stddev(stat)*1e3,
+                         profiler_stats_percentile(stat, 0.50)*1e3,
+                         profiler_stats_percentile(stat, 0.95)*1e3,
+                         profiler_stats_percentile(stat, 0.99)*1e3,
+                         stat->max*1e3, stat->budget_misses);
+        if (counters) {
+            n += snprintf(numbers_text + n, sizeof(numbers_text) - n, "  ipc %.2f", profiler_stats_ipc(stat));
+            if (stat->items) {
+                snprintf(numbers_text + n, sizeof(numbers_text) - n, "  l1 %.3f  llc %.3f  br %.3f /px",
+                         profiler_stats_per_item(stat, PROFILER_L1_MISSES),
+                         profiler_stats_per_item(stat, PROFILER_LLC_MISSES),
+                         profiler_stats_per_item(stat, PROFILER_BRANCH_MISSES));
+            }
+        }
 
 
+        draw_sparkline(stat,
+                screen_width - numbers_width - 10 - max_title_text_width - 10 - PROFILER_RECENT - 10,
+                y);
         DrawText(title_text,
-                screen_width - numbers_width - 10 - max_title_text_width - 10,
-                10 + i*FONT_SIZE,
+                screen_width - numbers_width - 10 - max_title_text_width - 10 + stat->depth*indent_width,
+                y,
                 FONT_SIZE, WHITE);
         DrawText(numbers_text,
                 screen_width - numbers_width - 10,
-                10 + i*FONT_SIZE,
+                y,
                 FONT_SIZE, WHITE);
+        y += FONT_SIZE;
     }
-
-    for (size_t i = 0; i < stats.count; i++) {
-        profiler_da_free(&stats.items[i].times);
-    }
-    profiler_da_free(&stats);
 }
 
 
@@ -105,31 +172,163 @@ void add_new_point() {
 }
 
 
+// rand() is one lock and one call at a time, too slow for millions of points.
+// so every loaded point's velocity comes from a hash of its index, 'data' is the seed.
+// https://prng.di.unimi.it/splitmix64.c
+void make_velocities(void *data, u64 start, u64 end, u64 thread) {
+    (void) thread;
+    u64 seed = *(u64 *) data;
+
+    for (u64 i = start; i < end; i++) {
+        u64 z = seed + (i + 1) * 0x9e3779b97f4a7c15;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        z = z ^ (z >> 31);
+
+        // 24 bits each for x and y, and one for each sign
+        Vector2 new_vel = {
+            .x = ((z >>  0) & 0xffffff) / (float) (1 << 24) * (SPEED-1) + 1,
+            .y = ((z >> 24) & 0xffffff) / (float) (1 << 24) * (SPEED-1) + 1,
+        };
+        if (z & (1ull << 48)) new_vel.x *= -1;
+        if (z & (1ull << 49)) new_vel.y *= -1;
+
+        points_vel.items[i] = new_vel;
+    }
+}
+
+// all the points from a file, instead of add_new_point(). (see seed_file.h)
+// false if it couldnt be loaded.
+bool load_points(const char *path) {
+    time_unit start = get_time();
+
+    Seed_File file;
+    if (!seed_file_open(&file, path)) return false;
+
+    // all at once, no da_append() doubling its way up
+    da_reserve(&points_pos,    file.count);
+    da_reserve(&points_vel,    file.count);
+    da_reserve(&points_colors, file.count);
+    points_pos   .count = file.count;
+    points_vel   .count = file.count;
+    points_colors.count = file.count;
+
+    seed_file_read(&file, (float *) points_pos.items, (u8 *) points_colors.items, screen_width, screen_height);
+
+    u64 seed = rand();
+    pool_for(file.count, 1 << 16, make_velocities, &seed);
+
+    printf("INFO: loaded %zu points from %s in %.3f s\n", file.count, path, elapsed_time_in_secs(start, get_time()));
+    seed_file_close(&file);
+    return true;
+}
+
+
+// move points in a random walk, 'data' is the frame time.
+// TODO make better
+void walk_points(void *data, u64 start, u64 end, u64 thread) {
+    (void) thread;
+    float delta = *(float *) data;
+
+    for (u64 i = start; i < end; i++) {
+        Vector2 *xy  = &points_pos.items[i];
+        Vector2 *vxy = &points_vel.items[i];
+
+        xy->x += vxy->x * delta;
+        xy->y += vxy->y * delta;
+
+        if (xy->x < 0)             vxy->x =  fabs(vxy->x);
+        if (xy->x > screen_width)  vxy->x = -fabs(vxy->x);
+
+        if (xy->y < 0)             vxy->y =  fabs(vxy->y);
+        if (xy->y > screen_height) vxy->y = -fabs(vxy->y);
+    }
+}
+
 int main(int argc, char const **argv) {
     const char *program = argv[0];
-    if (!(argc == 1 || argc == 2)) {
-        fprintf(stderr, "USAGE: %s [NUM_POINTS=10]\n", program);
-        return 1;
-    }
 
     u64 num_points = 10;
-    if (argc == 2) num_points = atol(argv[1]);
+    // --record writes every frame's points to a file, --replay plays them back
+    // as fast as it can, (one recorded frame a frame) and prints the profiler at the end.
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    // --load starts with the points in a file, instead of random ones
+    const char *load_path   = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--record") == 0 && i + 1 < argc) record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_path = argv[++i];
+        else if (strcmp(argv[i], "--load")   == 0 && i + 1 < argc) load_path   = argv[++i];
+        else if (argv[i][0] != '-' && i == argc - 1)               num_points  = atol(argv[i]);
+        else {
+            fprintf(stderr, "USAGE: %s [--record FILE | --replay FILE] [--load FILE] [NUM_POINTS=10]\n", program);
+            return 1;
+        }
+    }
+
+    // it would record the live points, not the ones that are drawn.
+    if (record_path && replay_path) {
+        fprintf(stderr, "ERROR: --record and --replay dont go together\n");
+        fprintf(stderr, "USAGE: %s [--record FILE | --replay FILE] [--load FILE] [NUM_POINTS=10]\n", program);
+        return 1;
+    }
 
     srand(time(0));
 
+    Trajectory_Writer recording = {0};
+    if (record_path && !trajectory_record_start(&recording, record_path, screen_width, screen_height)) {
+        fprintf(stderr, "ERROR: could not open '%s': %s\n", record_path, strerror(errno));
+        return 1;
+    }
+
+    Trajectory replay = {0};
+    Trajectory_Frame replay_frame = {0};
+    u64 replay_frames = 0;
+    if (replay_path) {
+        if (!trajectory_open(&replay, replay_path)) return 1;
+        if (!trajectory_next(&replay, &replay_frame)) {
+            fprintf(stderr, "ERROR: '%s' has no frames\n", replay_path);
+            return 1;
+        }
+        // the window starts the size it was recorded at
+        screen_width  = replay.width;
+        screen_height = replay.height;
+    }
+
 
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(screen_width, screen_height, "Voronoi");
 
+    PROFILER_NAME_THREAD("main thread");
+
+    // before init_voronoi(), so the backend gets the same threads.
+    pool_start();
     init_voronoi();
 
-    for (u64 i = 0; i < num_points; i++) add_new_point();
+    if (load_path && !replay_path) {
+        if (!load_points(load_path)) {
+            finish_voronoi();
+            pool_stop();
+            CloseWindow();
+            return 1;
+        }
+        num_points = points_pos.count;
+    } else {
+        for (u64 i = 0; i < num_points; i++) add_new_point();
+    }
 
     bool paused = false;
     bool reset_profiler = false;
     bool draw_points = true;
+    // if nothing moved since the last draw_voronoi(), the target already has it.
+    bool redraw = true;
 
     RenderTexture2D target = LoadRenderTexture(screen_width, screen_height);
+    if (replay_path) {
+        UnloadRenderTexture(target);
+        target = LoadRenderTexture(replay_frame.width, replay_frame.height);
+    }
 
     while (!WindowShouldClose()) {
         PROFILER_ZONE("total frame time");
@@ -141,8 +340,12 @@ int main(int argc, char const **argv) {
             screen_width  = new_width;
             screen_height = new_height;
 
-            UnloadRenderTexture(target);
-            target = LoadRenderTexture(screen_width, screen_height);
+            // a replay keeps the size it was recorded at
+            if (!replay_path) {
+                UnloadRenderTexture(target);
+                target = LoadRenderTexture(screen_width, screen_height);
+            }
+            redraw = true;
         }
 
         assert(screen_width > 0 && screen_height > 0);
@@ -152,9 +355,22 @@ int main(int argc, char const **argv) {
             paused         ^= IsKeyPressed(KEY_SPACE);
             reset_profiler ^= IsKeyPressed(KEY_R);
             draw_points    ^= IsKeyPressed(KEY_P);
+
+#ifdef PROFILE_CODE
+            if (IsKeyPressed(KEY_T)) {
+                if (profiler_tracing()) {
+                    profiler_trace_stop();
+                    printf("INFO: trace written to %s\n", TRACE_PATH);
+                } else if (profiler_trace_start(TRACE_PATH)) {
+                    printf("INFO: tracing to %s, 'T' again to stop\n", TRACE_PATH);
+                } else {
+                    fprintf(stderr, "ERROR: could not open %s\n", TRACE_PATH);
+                }
+            }
+#endif // PROFILE_CODE
         }
 
-        { // Change number of points
+        if (!replay_path) { // Change number of points
             size_t old_num_points = num_points;
 
             if (IsKeyPressed(KEY_UP)) {
@@ -181,53 +397,79 @@ int main(int argc, char const **argv) {
                 points_vel   .count = num_points;
                 points_colors.count = num_points;
             }
+
+            // (even if its the same number, some might have been swapped for new ones)
+            if (IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_DOWN) || IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_RIGHT)) {
+                redraw = true;
+            }
         }
 
 
         float delta = GetFrameTime();
         if (delta > 0.25) delta = 0.25;
         if (paused) delta = 0;
+        if (!paused) redraw = true;
 
 
-        PROFILER_ZONE("walk points");
-            // move points in a random walk
-            // TODO make better
-            for (size_t i = 0; i < num_points; i++) {
-                Vector2 *xy  = &points_pos.items[i];
-                Vector2 *vxy = &points_vel.items[i];
-
-                xy->x += vxy->x * delta;
-                xy->y += vxy->y * delta;
+        if (!replay_path) {
+            PROFILER_ZONE("walk points");
+                // the backends threads are sitting around at this point anyway.
+                pool_for(num_points, 4096, walk_points, &delta);
+            PROFILER_ZONE_END();
+        } else if (!paused && replay_frames > 0) {
+            // the next recorded frame, no matter how long this one took
+            if (!trajectory_next(&replay, &replay_frame)) break;
 
-                if (xy->x < 0)             vxy->x =  fabs(vxy->x);
-                if (xy->x > screen_width)  vxy->x = -fabs(vxy->x);
+            if ((u64) target.texture.width != replay_frame.width || (u64) target.texture.height != replay_frame.height) {
+                UnloadRenderTexture(target);
+                target = LoadRenderTexture(replay_frame.width, replay_frame.height);
+            }
+        }
 
-                if (xy->y < 0)             vxy->y =  fabs(vxy->y);
-                if (xy->y > screen_height) vxy->y = -fabs(vxy->y);
+        if (record_path && recording.file) {
+            PROFILER_ZONE("record points");
+            if (!trajectory_record_frame(&recording, screen_width, screen_height, delta,
+                                         (float *) points_pos.items, (u8 *) points_colors.items, num_points)) {
+                fprintf(stderr, "ERROR: could not write to '%s', stopped recording\n", record_path);
+                trajectory_record_stop(&recording);
             }
-        PROFILER_ZONE_END();
+            PROFILER_ZONE_END();
+        }
+
+        // what gets drawn, the recording says, if theres one playing.
+        // (draw_voronoi() only reads them, so the mapped file is fine)
+        Vector2 *frame_points     = points_pos.items;
+        Color   *frame_colors     = points_colors.items;
+        u64      frame_num_points = num_points;
+        if (replay_path) {
+            frame_points     = (Vector2 *) replay_frame.points;
+            frame_colors     = (Color   *) replay_frame.colors;
+            frame_num_points = replay_frame.num_points;
+            if (!paused) replay_frames += 1;
+        }
 
 
         BeginDrawing();
         ClearBackground(MAGENTA);
 
         PROFILER_ZONE("voronoi the background");
-            draw_voronoi(target, points_pos.items, points_colors.items, num_points);
+            if (redraw) draw_voronoi(target, frame_points, frame_colors, frame_num_points);
+            redraw = false;
 
             DrawTexture(target.texture, 0, 0, WHITE);
         PROFILER_ZONE_END();
 
         PROFILER_ZONE("draw the points");
         if (draw_points) {
-            for (u64 i = 0; i < num_points; i++) {
-                DrawCircleV(points_pos.items[i], 10, BLUE);
-                DrawCircleV(points_pos.items[i], 7, points_colors.items[i]);
+            for (u64 i = 0; i < frame_num_points; i++) {
+                DrawCircleV(frame_points[i], 10, BLUE);
+                DrawCircleV(frame_points[i], 7, frame_colors[i]);
             }
         }
         PROFILER_ZONE_END();
 
         { // draw num points
-            const char *text = TextFormat("Points: %6zu", num_points);
+            const char *text = TextFormat("Points: %6zu", frame_num_points);
             int text_width = MeasureText(text, FONT_SIZE);
             DrawText(text, screen_width/2 - text_width/2, 10, FONT_SIZE, WHITE);
         }
@@ -245,7 +487,6 @@ int main(int argc, char const **argv) {
 
         PROFILER_ZONE_END();
 
-        reset_profiler |= profiler_zone_count() > 65536;
         if (reset_profiler) {
             reset_profiler = false;
             PROFILER_RESET();
@@ -254,9 +495,31 @@ int main(int argc, char const **argv) {
 
     UnloadRenderTexture(target);
 
+    if (record_path && recording.file) {
+        if (trajectory_record_stop(&recording)) {
+            printf("INFO: recorded %zu frames to %s\n", recording.num_frames, record_path);
+        } else {
+            fprintf(stderr, "ERROR: could not finish writing '%s'\n", record_path);
+        }
+    }
+    if (replay_path) {
+        printf("INFO: replayed %zu frames of %s\n", replay_frames, replay_path);
+        // the same recording on every backend, so these can be compared
+        PROFILER_PRINT();
+        trajectory_close(&replay);
+    }
+
     finish_voronoi();
 
+    pool_print_stats(stderr);
+    pool_stop();
+
     CloseWindow();
+
+#ifdef PROFILE_CODE
+    if (profiler_tracing()) printf("INFO: trace written to %s\n", TRACE_PATH);
+#endif // PROFILE_CODE
+    // (this writes the rest of the trace)
     PROFILER_FREE();
 
     return 0;
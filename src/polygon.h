@@ -0,0 +1,206 @@
+//
+// polygon.h - convex polygons, for the backends that work out the cells with math
+//
+// the polygons are clockwise (on the screen, y going down), and get
+// drawn as a fan of triangles, or filled into a label buffer.
+//
+// everything in here is static, every backend gets its own copy.
+// (the bench links them all into the one binary)
+//
+
+#ifndef POLYGON_H_
+#define POLYGON_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "ints.h"
+#include "dynamic_array.h"
+#include "voronoi_compute.h"
+
+#ifndef VORONOI_HEADLESS
+#include "raylib.h"
+#endif // VORONOI_HEADLESS
+
+
+#define SWAP(a, b) do {typeof(a) tmp = a; a = b; b = tmp;} while(0)
+
+// TODO actually use floating inf
+#define FINF 999999999.0f
+
+
+typedef struct DoubleVector2 {
+    double x, y;
+} DoubleVector2;
+
+
+typedef struct Polygon {
+    // the points of the polygon
+    DoubleVector2 *items;
+    u64 count;
+    u64 capacity;
+} Polygon;
+
+
+#ifndef VORONOI_HEADLESS
+
+// draw a convex polygon, with points in clockwise order
+// flip height, if not zero, flip vertical
+static inline void draw_polygon(Polygon polygon, Color color, int flip_height) {
+    if (polygon.count < 3) return;
+
+    for (u64 i = 1; i < polygon.count - 1; i++) {
+        Vector2 v1 = {polygon.items[0  ].x, polygon.items[0  ].y};
+        Vector2 v2 = {polygon.items[i  ].x, polygon.items[i  ].y};
+        Vector2 v3 = {polygon.items[i+1].x, polygon.items[i+1].y};
+
+        if (flip_height) {
+            v1.y = flip_height - v1.y;
+            v2.y = flip_height - v2.y;
+            v3.y = flip_height - v3.y;
+
+            SWAP(v2, v3);
+        }
+
+        // DrawLineEx(v1, v2, 10, GOLD);
+        // DrawLineEx(v2, v3, 10, GOLD);
+        // DrawLineEx(v1, v3, 10, GOLD);
+
+        // draw the points in reverse order, because the polygon is always clockwise.
+        DrawTriangle(v3, v2, v1, color);
+    }
+}
+
+#endif // VORONOI_HEADLESS
+
+
+// fill a convex polygon into a label buffer (top row first).
+// a pixel is inside if its (x, y) is, edges are half open
+// so neighboring polygons dont fight over the same pixels.
+static void fill_polygon(u32 *labels, u64 width, u64 height, Polygon polygon, u32 label) {
+    if (polygon.count < 3) return;
+
+    double min_y = polygon.items[0].y;
+    double max_y = polygon.items[0].y;
+    for (u64 i = 1; i < polygon.count; i++) {
+        if (min_y > polygon.items[i].y) min_y = polygon.items[i].y;
+        if (max_y < polygon.items[i].y) max_y = polygon.items[i].y;
+    }
+
+    s64 start_y = ceil(min_y);
+    s64 end_y   = ceil(max_y);
+    if (start_y < 0)              start_y = 0;
+    if (end_y   > (s64) height)   end_y   = height;
+
+    for (s64 j = start_y; j < end_y; j++) {
+        double left  =  FINF;
+        double right = -FINF;
+
+        // for a convex polygon, exactly two edges cross the row.
+        for (u64 i = 0; i < polygon.count; i++) {
+            DoubleVector2 p1 = polygon.items[i];
+            DoubleVector2 p2 = polygon.items[(i+1)%polygon.count];
+            if (p2.y < p1.y) SWAP(p1, p2);
+
+            if (!(p1.y <= j && j < p2.y)) continue;
+
+            double x = p1.x + (j - p1.y) * (p2.x - p1.x) / (p2.y - p1.y);
+            if (left  > x) left  = x;
+            if (right < x) right = x;
+        }
+
+        s64 start_x = ceil(left);
+        s64 end_x   = ceil(right);
+        if (start_x < 0)            start_x = 0;
+        if (end_x   > (s64) width)  end_x   = width;
+
+        for (s64 i = start_x; i < end_x; i++) {
+            labels[j*width + i] = label;
+        }
+    }
+}
+
+
+// cut away the part of 'polygon' that is closer to 'other' than to 'point'.
+// 'scratch' gets swapped with 'polygon', so both need to stay around.
+// https://en.wikipedia.org/wiki/Sutherland%E2%80%93Hodgman_algorithm
+static inline void cut_polygon(Polygon *polygon, Polygon *scratch, DoubleVector2 point, DoubleVector2 other) {
+    // the mid point, and the direction to the other point
+    DoubleVector2 m = {(point.x + other.x) / 2, (point.y + other.y) / 2};
+    DoubleVector2 v = {other.x - point.x, other.y - point.y};
+
+    // most of the time the line misses, dont copy anything then.
+    bool misses = true;
+    for (u64 i = 0; i < polygon->count; i++) {
+        DoubleVector2 p = polygon->items[i];
+        if ((p.x - m.x)*v.x + (p.y - m.y)*v.y > 0) {
+            misses = false;
+            break;
+        }
+    }
+    if (misses) return;
+
+    scratch->count = 0;
+    for (u64 i = 0; i < polygon->count; i++) {
+        DoubleVector2 p1 = polygon->items[i];
+        DoubleVector2 p2 = polygon->items[(i+1)%polygon->count];
+
+        // how far past the mid line they are, (positive is the other points side)
+        double s1 = (p1.x - m.x)*v.x + (p1.y - m.y)*v.y;
+        double s2 = (p2.x - m.x)*v.x + (p2.y - m.y)*v.y;
+
+        if (s1 <= 0) da_append(scratch, p1);
+
+        // the edge crosses the mid line
+        if ((s1 <= 0) != (s2 <= 0)) {
+            double t = s1 / (s1 - s2);
+            da_append(scratch, ((DoubleVector2){p1.x + t*(p2.x - p1.x), p1.y + t*(p2.y - p1.y)}));
+        }
+    }
+
+    SWAP(*polygon, *scratch);
+}
+
+
+// when every cell is cut on its own, an edge can come out a hair different for
+// the two cells on either side of it, and a pixel right on it ends up in neither.
+// those go to whichever of the pixels next to them has the closest point.
+// (only the ones in [x0, x1) x [y0, y1), for when only some of the cells changed)
+static inline void fill_cracks_rect(u32 *labels, u64 width, u64 height, const float *points,
+                                    u64 x0, u64 y0, u64 x1, u64 y1) {
+    for (u64 j = y0; j < y1; j++) {
+        for (u64 i = x0; i < x1; i++) {
+            if (labels[j*width + i] != VORONOI_NO_LABEL) continue;
+
+            u32 around[4] = {
+                i > 0          ? labels[j*width + i-1]   : VORONOI_NO_LABEL,
+                i < width-1    ? labels[j*width + i+1]   : VORONOI_NO_LABEL,
+                j > 0          ? labels[(j-1)*width + i] : VORONOI_NO_LABEL,
+                j < height-1   ? labels[(j+1)*width + i] : VORONOI_NO_LABEL,
+            };
+
+            u32 best = VORONOI_NO_LABEL;
+            float best_d = INFINITY;
+            for (u64 k = 0; k < 4; k++) {
+                u32 label = around[k];
+                if (label == VORONOI_NO_LABEL) continue;
+
+                // same as seed_soa_nearest() in seed_soa.h
+                float x = i, y = j;
+                float d = (points[2*label]-x)*(points[2*label]-x) + (points[2*label + 1]-y)*(points[2*label + 1]-y);
+                if (d < best_d || (d == best_d && label < best)) {
+                    best_d = d;
+                    best = label;
+                }
+            }
+            labels[j*width + i] = best;
+        }
+    }
+}
+
+static inline void fill_cracks(u32 *labels, u64 width, u64 height, const float *points) {
+    fill_cracks_rect(labels, width, height, points, 0, 0, width, height);
+}
+
+#endif // POLYGON_H_
@@ -0,0 +1,153 @@
+//
+// present.h - get a label map onto a render texture
+//
+// the CPU backends used to find every run of the same color in
+// a row and DrawRectangle() it, which is one draw call per cell
+// per row. this just turns the labels into colors and uploads
+// the lot with UpdateTexture(), so it costs O(bytes) no matter
+// how many points there are.
+//
+// the label map is top row first, which is already the order
+// the texture wants it in, (drawing into a render texture with
+// BeginTextureMode() is what needed the flip) so no flip here.
+//
+
+#ifndef PRESENT_H_
+#define PRESENT_H_
+
+#include <stddef.h>
+
+#include "raylib.h"
+
+#include "ints.h"
+
+// when set, only the rows that changed since the last call are uploaded.
+extern bool present_only_changed_rows;
+
+// uploads 'labels' (width*height of target, top row first) into 'target'
+void present_labels(RenderTexture2D target, const u32 *labels, const Color *colors, size_t num_points);
+// same, but only looks at the rows where 'rows' is true, the rest are the same as last call.
+// ('rows' is height long, NULL for all of them)
+void present_labels_rows(RenderTexture2D target, const u32 *labels, const Color *colors, size_t num_points, const bool *rows);
+
+void present_free(void);
+
+#endif // PRESENT_H_
+
+
+#ifdef PRESENT_IMPLEMENTATION
+
+#ifndef PRESENT_IMPLEMENTATION_
+#define PRESENT_IMPLEMENTATION_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// uploading a few unchanged rows is cheaper than another UpdateTextureRec() call
+#define PRESENT_ROW_GAP 16
+
+bool present_only_changed_rows = true;
+
+// what is currently in the texture, so we know what changed.
+static Color *present_pixels = 0;
+static Color *present_row    = 0;
+static u64 present_capacity  = 0;
+static u64 present_width     = 0;
+
+// the texture the pixels are for, anything else gets a full upload.
+static unsigned int present_texture_id = 0;
+static int present_texture_width  = 0;
+static int present_texture_height = 0;
+
+
+static void present_upload_rows(Texture2D texture, u64 start, u64 end) {
+    Rectangle rec = {0, start, texture.width, end - start};
+    UpdateTextureRec(texture, rec, present_pixels + start*texture.width);
+}
+
+void present_labels(RenderTexture2D target, const u32 *labels, const Color *colors, size_t num_points) {
+    present_labels_rows(target, labels, colors, num_points, NULL);
+}
+
+void present_labels_rows(RenderTexture2D target, const u32 *labels, const Color *colors, size_t num_points, const bool *rows) {
+    Texture2D texture = target.texture;
+    u64 width  = texture.width;
+    u64 height = texture.height;
+
+    if (present_capacity < width * height) {
+        present_capacity = width * height;
+        free(present_pixels);
+        present_pixels = malloc(present_capacity * sizeof(Color));
+        assert(present_pixels != NULL && "Buy More RAM lol");
+        // forget what was in there.
+        present_texture_id = 0;
+    }
+    if (present_width < width) {
+        present_width = width;
+        free(present_row);
+        present_row = malloc(present_width * sizeof(Color));
+        assert(present_row != NULL && "Buy More RAM lol");
+    }
+
+    bool full_upload = !present_only_changed_rows
+                    || present_texture_id     != texture.id
+                    || present_texture_width  != texture.width
+                    || present_texture_height != texture.height;
+
+    present_texture_id     = texture.id;
+    present_texture_width  = texture.width;
+    present_texture_height = texture.height;
+
+    if (full_upload) {
+        for (u64 i = 0; i < width * height; i++) {
+            u32 label = labels[i];
+            present_pixels[i] = label < num_points ? colors[label] : BLACK;
+        }
+
+        UpdateTexture(texture, present_pixels);
+        return;
+    }
+
+    // the start of the rows that are waiting to be uploaded, if any.
+    s64 dirty_start = -1;
+    u64 dirty_end   = 0;
+
+    for (u64 j = 0; j < height; j++) {
+        if (rows && !rows[j]) continue;
+
+        const u32 *label_row = &labels[j*width];
+        Color *pixel_row = &present_pixels[j*width];
+
+        for (u64 i = 0; i < width; i++) {
+            u32 label = label_row[i];
+            present_row[i] = label < num_points ? colors[label] : BLACK;
+        }
+
+        if (memcmp(present_row, pixel_row, width * sizeof(Color)) == 0) continue;
+        memcpy(pixel_row, present_row, width * sizeof(Color));
+
+        if (dirty_start != -1 && j - dirty_end > PRESENT_ROW_GAP) {
+            present_upload_rows(texture, dirty_start, dirty_end);
+            dirty_start = -1;
+        }
+        if (dirty_start == -1) dirty_start = j;
+        dirty_end = j + 1;
+    }
+
+    if (dirty_start != -1) present_upload_rows(texture, dirty_start, dirty_end);
+}
+
+void present_free(void) {
+    free(present_pixels);
+    free(present_row);
+    present_pixels     = 0;
+    present_row        = 0;
+    present_capacity   = 0;
+    present_width      = 0;
+    present_texture_id = 0;
+}
+
+#endif // PRESENT_IMPLEMENTATION_
+
+#endif // PRESENT_IMPLEMENTATION
@@ -4,8 +4,22 @@
 #define PROFILER_H_
 
 #ifdef PROFILE_CODE
-    #define PROFILER_ZONE(title) profiler_zone(title, __FILE__, __LINE__)
+    // every call site is a Profiler_Site, every thread keeps its own stats for it.
+    #define PROFILER_ZONE(zone_title)                                                         \
+        do {                                                                                  \
+            static const Profiler_Site profiler_site_ = {                                     \
+                .title = (zone_title), .file = __FILE__, .line = __LINE__,                    \
+            };                                                                                \
+            profiler_zone(&profiler_site_);                                                   \
+        } while (0)
     #define PROFILER_ZONE_END()  profiler_zone_end()
+    // how many things (pixels, points) the innermost open zone worked on, for the per item counters
+    #define PROFILER_ZONE_ITEMS(n) profiler_zone_items(n)
+
+    #define PROFILER_NAME_THREAD(name) profiler_name_thread(name)
+
+    #define PROFILER_TRACE_START(path) profiler_trace_start(path)
+    #define PROFILER_TRACE_STOP()      profiler_trace_stop()
 
     #define PROFILER_PRINT() profiler_print()
     #define PROFILER_RESET() profiler_reset()
@@ -13,6 +27,12 @@
 #else
     #define PROFILER_ZONE(...)
     #define PROFILER_ZONE_END()
+    #define PROFILER_ZONE_ITEMS(...)
+
+    #define PROFILER_NAME_THREAD(...)
+
+    #define PROFILER_TRACE_START(...)
+    #define PROFILER_TRACE_STOP()
 
     #define PROFILER_PRINT()
     #define PROFILER_RESET()
@@ -21,6 +41,8 @@
 
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
 #include <time.h>
 
 #ifndef PROFILER_ASSERT
@@ -33,48 +55,143 @@
     #define USE_BETTER_CLOCK
 #endif
 
-#ifdef USE_BETTER_CLOCK
+// define PROFILER_COUNTERS to also count cycles, cache misses and such for every zone,
+// with linux's perf_event_open. anywhere else, (or when the kernel says no) theres just no counts.
+#if defined(PROFILER_COUNTERS) && !defined(__linux__)
+    #undef PROFILER_COUNTERS
+#endif
+
+// define PROFILER_TSC to time with the cpu's time stamp counter, (rdtsc) its a lot
+// cheaper than clock_gettime(), so zones can go inside the tile loops. its only
+// used when the cpu says the counter runs at the same rate all the time, (invariant TSC)
+// otherwise its clock_gettime() again. x86 only.
+#if defined(PROFILER_TSC) && !(defined(__x86_64__) || defined(__i386__))
+    #undef PROFILER_TSC
+#endif
+
+#if defined(PROFILER_TSC)
+    // ticks, see elapsed_time_in_secs()
+    typedef unsigned long long time_unit;
+#elif defined(USE_BETTER_CLOCK)
     typedef struct timespec time_unit;
 #else
     typedef clock_t time_unit;
 #endif
 
-typedef struct Profiler_Data {
-    const char *title;
-    const char *file; // these could be useful
-    int         line; // these could be useful
+// how many of the last times every zone keeps around
+#ifndef PROFILER_RECENT
+#define PROFILER_RECENT 128
+#endif
 
-    time_unit start_time;
-    time_unit end_time;
-    int end_set;
-} Profiler_Data;
+// the histograms have 2^PROFILER_HISTOGRAM_SUB_BITS buckets for every power of two
+// nanoseconds, so a percentile is off by at most 1/8th. (like HdrHistogram does it)
+#ifndef PROFILER_HISTOGRAM_SUB_BITS
+#define PROFILER_HISTOGRAM_SUB_BITS 3
+#endif
+// up to 2^40 ns, about 18 minutes, anything longer goes in the last bucket.
+#define PROFILER_HISTOGRAM_MAX_BITS 40
+#define PROFILER_HISTOGRAM_BUCKETS ((PROFILER_HISTOGRAM_MAX_BITS - PROFILER_HISTOGRAM_SUB_BITS + 1) << PROFILER_HISTOGRAM_SUB_BITS)
 
-typedef struct Profiler_Data_Array {
-    Profiler_Data *items;
-    size_t count;
-    size_t capacity;
-} Profiler_Data_Array;
+// a zone that takes longer than this is a budget miss, (one frame at 60fps) see profiler_set_budget()
+#ifndef PROFILER_BUDGET
+#define PROFILER_BUDGET (1.0 / 60.0)
+#endif
 
-typedef struct Double_Array {
-    double *items;
-    size_t count;
-    size_t capacity;
-} Double_Array;
+// room for this many zones on every thread from the start, so
+// a new zone doesnt realloc, (it still can, past this many)
+#ifndef PROFILER_PREALLOC_ZONES
+#define PROFILER_PREALLOC_ZONES 64
+#endif
+
+// how deep zones can go inside each other
+#ifndef PROFILER_MAX_DEPTH
+#define PROFILER_MAX_DEPTH 64
+#endif
+
+// how many threads can have zones, (since the last profiler_free())
+#ifndef PROFILER_MAX_THREADS
+#define PROFILER_MAX_THREADS 256
+#endif
+
+// how many zones a thread collects before handing them to the trace writer
+#ifndef PROFILER_TRACE_CHUNK
+#define PROFILER_TRACE_CHUNK 4096
+#endif
+
+// no parent, no child, no sibling.
+#define PROFILER_NONE ((size_t) -1)
+
+// the hardware counters, (see PROFILER_COUNTERS)
+typedef enum Profiler_Counter {
+    PROFILER_CYCLES,
+    PROFILER_INSTRUCTIONS,
+    PROFILER_L1_MISSES,
+    PROFILER_LLC_MISSES,
+    PROFILER_BRANCH_MISSES,
+    PROFILER_NUM_COUNTERS,
+} Profiler_Counter;
+
+static const char *const profiler_counter_names[PROFILER_NUM_COUNTERS] = {
+    [PROFILER_CYCLES]        = "cycles",
+    [PROFILER_INSTRUCTIONS]  = "instructions",
+    [PROFILER_L1_MISSES]     = "l1_misses",
+    [PROFILER_LLC_MISSES]    = "llc_misses",
+    [PROFILER_BRANCH_MISSES] = "branch_misses",
+};
+
+// one for every PROFILER_ZONE() in the code.
+typedef struct Profiler_Site {
+    const char *title;
 
+    const char *file;
+    int         line;
+} Profiler_Site;
 
-// collects like Profile data, useing file line and func
+// the times of one zone, on one thread, inside one parent zone. it keeps a
+// running tally of the times, so it doesnt get any bigger the longer it runs.
 typedef struct Profiler_Stats {
     const char *title;
 
     const char *file;
     int         line;
-    const char *func;
 
-    Double_Array times;
+    const Profiler_Site *site;
+    // which thread, and its name
+    size_t thread;
+    const char *thread_name;
+
+    // its place in the threads tree of zones, (indices in the threads zones)
+    // 'depth' is 0 for a zone thats not inside any other.
+    size_t depth;
+    size_t parent;
+    size_t first_child;
+    size_t next_sibling;
+
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm
+    size_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+
+    // how many took longer than the budget
+    size_t budget_misses;
+
+    // the last PROFILER_RECENT times, the next one goes at recent_next
+    double recent[PROFILER_RECENT];
+    size_t recent_next;
+
+    // every time ever, in log sized buckets. see profiler_stats_percentile()
+    unsigned int histogram[PROFILER_HISTOGRAM_BUCKETS];
+
+    // added up over every time, (the ones that couldnt be opened stay 0)
+    unsigned long long counters[PROFILER_NUM_COUNTERS];
+    // added up from PROFILER_ZONE_ITEMS()
+    unsigned long long items;
 } Profiler_Stats;
 
 typedef struct Profiler_Stats_Array {
-    Profiler_Stats *items;
+    Profiler_Stats **items;
     size_t count;
     size_t capacity;
 } Profiler_Stats_Array;
@@ -84,18 +201,50 @@ time_unit get_time(void);
 double elapsed_time_in_secs(time_unit start, time_unit end);
 
 
-int profiler_equal(Profiler_Data a, Profiler_Data b);
-
-void profiler_zone(const char *title, const char *__file__, int __line__);
+// these only touch the calling threads own zones, no locks.
+void profiler_zone(const Profiler_Site *site);
 void profiler_zone_end(void);
 
+// adds to the innermost zone thats open on this thread.
+void profiler_zone_items(unsigned long long items);
+
+// shows up next to the zones of this thread, (copied)
+void profiler_name_thread(const char *name);
+
+// these look at every threads zones, so call them when the
+// other threads are not in a zone. (like between pool_for()'s)
 void profiler_print(void);
 void profiler_reset(void);
 void profiler_free(void);
 
-Profiler_Stats_Array collect_stats(void);
+// every zone thats been hit so far, thread by thread, every zone followed by the zones inside it.
+// this is the profilers own array, dont free it, its good until the next zone is hit.
+Profiler_Stats_Array profiler_stats(void);
+
+double profiler_stats_stddev(const Profiler_Stats *stats);
+// 'p' in [0, 1], from the histogram, so its a little over, (never over the max)
+double profiler_stats_percentile(const Profiler_Stats *stats, double p);
+// the last (up to) PROFILER_RECENT times, oldest first, into 'times'. returns how many.
+size_t profiler_stats_recent(const Profiler_Stats *stats, double times[PROFILER_RECENT]);
+
+// which counters some thread got to open, a bit for each Profiler_Counter. (0 without PROFILER_COUNTERS)
+unsigned int profiler_counters_available(void);
+// instructions per cycle, 0 if either is missing
+double profiler_stats_ipc(const Profiler_Stats *stats);
+// the counter over the items, 0 if there were no items
+double profiler_stats_per_item(const Profiler_Stats *stats, Profiler_Counter counter);
+
+// in seconds, for the budget misses from now on.
+void   profiler_set_budget(double secs);
+double profiler_get_budget(void);
 
-size_t profiler_zone_count(void);
+// writes every zone that ends from now on to 'path', as a Chrome trace. (chrome://tracing or ui.perfetto.dev)
+// the writing is on its own thread, a zone only gets copied into a buffer.
+// returns 0 if the file could not be opened.
+int  profiler_trace_start(const char *path);
+// writes whats left and closes the file, same rules as profiler_print().
+void profiler_trace_stop(void);
+int  profiler_tracing(void);
 
 
 #define profiler_da_append(da, item)                                                                        \
@@ -128,8 +277,163 @@ size_t profiler_zone_count(void);
 #define PROFILER_IMPLEMENTATION_
 
 
-Profiler_Data_Array __base_zones = {0};
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef PROFILER_TSC
+    #include <x86intrin.h>
+    #include <cpuid.h>
+#endif // PROFILER_TSC
+
+#ifdef PROFILER_COUNTERS
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #include <string.h>
+    #include <errno.h>
+#endif // PROFILER_COUNTERS
+
+// the zones that havent ended yet, innermost last
+typedef struct Profiler_Open {
+    size_t zone;
+    time_unit start_time;
+#ifdef PROFILER_COUNTERS
+    unsigned long long counters[PROFILER_NUM_COUNTERS];
+#endif // PROFILER_COUNTERS
+} Profiler_Open;
+
+// everything one thread has, only that thread writes to it.
+typedef struct Profiler_Thread {
+    size_t index;
+    char name[32];
+
+    struct {
+        Profiler_Stats *items;
+        size_t count;
+        size_t capacity;
+    } zones;
+    // the first zone thats not inside any other
+    size_t first_root;
+
+    Profiler_Open open[PROFILER_MAX_DEPTH];
+    size_t depth;
+    // the last zone that was opened at every depth, a zone in a loop is
+    // usually the same one as last time, so it doesnt need looking for.
+    size_t last[PROFILER_MAX_DEPTH];
+
+#ifdef PROFILER_COUNTERS
+    // all the counters are in one group, so they start and stop together, and
+    // one read() gets them all. the ones that opened are in the order of 'slot'.
+    int counter_fds[PROFILER_NUM_COUNTERS];
+    int counter_leader;
+    size_t counter_slot[PROFILER_NUM_COUNTERS];
+    size_t num_counters;
+#endif // PROFILER_COUNTERS
+
+    // the zones that ended since the last chunk went to the writer
+    struct Profiler_Trace_Chunk *trace;
+    // the chunks the writer is done with, it gives them back here, and the
+    // thread takes them all at once into 'spares'. (so theres no ABA problem)
+    _Atomic(struct Profiler_Trace_Chunk *) returned;
+    struct Profiler_Trace_Chunk *spares;
+} Profiler_Thread;
+
+typedef struct Profiler_Trace_Event {
+    const Profiler_Site *site;
+    time_unit start_time;
+    time_unit end_time;
+} Profiler_Trace_Event;
+
+// the threads fill these, and push them on a list for the writer,
+// who gives them back to their thread when its done with them.
+typedef struct Profiler_Trace_Chunk {
+    struct Profiler_Trace_Chunk *next;
+    size_t thread;
+    size_t count;
+    Profiler_Trace_Event events[PROFILER_TRACE_CHUNK];
+} Profiler_Trace_Chunk;
+
+typedef struct Profiler_Trace {
+    _Atomic int on;
+    FILE *file;
+    char *file_buffer;
+    time_unit start_time;
+    // nothing written yet, so no ',' first
+    int first;
+
+    pthread_t writer;
+    _Atomic int stopping;
+
+    // full, and waiting to be written
+    _Atomic(Profiler_Trace_Chunk *) full;
+} Profiler_Trace;
 
+// every thread that ever started a zone, threads only ever get added.
+Profiler_Thread *__profiler_threads[PROFILER_MAX_THREADS];
+_Atomic size_t __profiler_num_threads = 0;
+// only for adding threads
+atomic_flag __profiler_threads_lock = ATOMIC_FLAG_INIT;
+// bumped by profiler_free(), so the threads know theirs is gone.
+_Atomic size_t __profiler_generation = 1;
+
+_Thread_local Profiler_Thread *__profiler_this_thread = NULL;
+_Thread_local size_t __profiler_this_generation = 0;
+
+// what profiler_stats() gives out
+Profiler_Stats_Array __profiler_collected = {0};
+
+// the counters that any thread managed to open
+_Atomic unsigned int __profiler_counters_mask = 0;
+// so the 'no counters' message only comes once
+atomic_flag __profiler_counters_warned = ATOMIC_FLAG_INIT;
+
+Profiler_Trace __profiler_trace = {0};
+
+
+#ifdef PROFILER_TSC
+
+// set before main(), by profiler_tsc_calibrate()
+int    __profiler_tsc_invariant = 0;
+double __profiler_secs_per_tick = 1e-9;
+
+// measures how fast the counter goes against CLOCK_MONOTONIC, once.
+__attribute__((constructor))
+static void profiler_tsc_calibrate(void) {
+    // cpuid 0x80000007, edx bit 8, the 'invariant TSC' bit
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+        fprintf(stderr, "INFO: profiler: no invariant TSC, timing with clock_gettime()\n");
+        return;
+    }
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    unsigned long long start_ticks = __rdtsc();
+
+    // 10 ms is plenty, that gets it to about 0.01%
+    double secs = 0;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        secs = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+    } while (secs < 0.01);
+    unsigned long long end_ticks = __rdtsc();
+
+    __profiler_secs_per_tick = secs / (double) (end_ticks - start_ticks);
+    __profiler_tsc_invariant = 1;
+}
+
+time_unit get_time(void) {
+    if (__profiler_tsc_invariant) return __rdtsc();
+
+    struct timespec item;
+    clock_gettime(CLOCK_MONOTONIC, &item);
+    return (time_unit) item.tv_sec * 1000000000ull + item.tv_nsec;
+}
+double elapsed_time_in_secs(time_unit start, time_unit finish) {
+    return (double) (finish - start) * __profiler_secs_per_tick;
+}
+
+#else
 
 time_unit get_time(void) {
 #ifdef USE_BETTER_CLOCK
@@ -154,179 +458,638 @@ double elapsed_time_in_secs(time_unit start, time_unit finish) {
 #endif
 }
 
-int profiler_equal(Profiler_Data a, Profiler_Data b) {
-    if (a.title != b.title) return 0;
-    if (a.file != b.file) return 0;
-    if (a.line != b.line) return 0;
-    return 1;
+#endif // PROFILER_TSC
+
+
+double __profiler_budget = PROFILER_BUDGET;
+
+void profiler_set_budget(double secs) {
+    __profiler_budget = secs;
+}
+double profiler_get_budget(void) {
+    return __profiler_budget;
 }
 
 
-// profile the things after this call
-// will stop with profiler_end_zone
-void profiler_zone(const char *title, const char *__file__, int __line__) {
-    time_unit start = get_time();
-    Profiler_Data data = {
-        .title = title,
-        .start_time = start,
-        // .end_time = 0,
-        .end_set = 0,
+// the bucket for 'ns', the first 2^SUB_BITS are exact, after
+// that its the top SUB_BITS bits below the highest one.
+static size_t profiler_histogram_bucket(unsigned long long ns) {
+    const unsigned long long sub_count = 1ull << PROFILER_HISTOGRAM_SUB_BITS;
+    if (ns < sub_count) return ns;
 
-        .file = __file__,
-        .line = __line__,
-    };
+    int top = 63 - __builtin_clzll(ns);
+    if (top >= PROFILER_HISTOGRAM_MAX_BITS) return PROFILER_HISTOGRAM_BUCKETS - 1;
 
-    profiler_da_append(&__base_zones, data);
+    int shift = top - PROFILER_HISTOGRAM_SUB_BITS;
+    size_t sub = (ns >> shift) & (sub_count - 1);
+    return ((size_t) (shift + 1) << PROFILER_HISTOGRAM_SUB_BITS) + sub;
 }
 
-void profiler_zone_end(void) {
-    time_unit end = get_time();
+// the biggest ns that goes in 'bucket'
+static double profiler_histogram_top(size_t bucket) {
+    const size_t sub_count = 1ull << PROFILER_HISTOGRAM_SUB_BITS;
+    if (bucket < sub_count) return bucket;
 
-    for (int i = __base_zones.count-1; i >= 0; i--) {
-        Profiler_Data *it = &__base_zones.items[i];
+    int shift = (bucket >> PROFILER_HISTOGRAM_SUB_BITS) - 1;
+    size_t sub = bucket & (sub_count - 1);
+    return (double) (((sub_count + sub + 1) << shift) - 1);
+}
 
-        // if its not zero, this zone has already been completed...
-        if (it->end_set) continue;
 
-        it->end_time = end;
-        it->end_set = 1;
-        return;
+static void profiler_stats_clear(Profiler_Stats *stats) {
+    stats->count = 0;
+    stats->mean  = 0;
+    stats->m2    = 0;
+    stats->min   = 0;
+    stats->max   = 0;
+    stats->budget_misses = 0;
+    stats->recent_next = 0;
+    for (size_t i = 0; i < PROFILER_HISTOGRAM_BUCKETS; i++) stats->histogram[i] = 0;
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) stats->counters[i] = 0;
+    stats->items = 0;
+}
+
+static void profiler_stats_add(Profiler_Stats *stats, double time) {
+    stats->count += 1;
+    double delta = time - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2   += delta * (time - stats->mean);
+
+    if (stats->count == 1 || time < stats->min) stats->min = time;
+    if (stats->count == 1 || time > stats->max) stats->max = time;
+
+    if (time > __profiler_budget) stats->budget_misses += 1;
+
+    stats->recent[stats->recent_next] = time;
+    stats->recent_next = (stats->recent_next + 1) % PROFILER_RECENT;
+
+    double ns = time * 1e9;
+    stats->histogram[profiler_histogram_bucket(ns > 0 ? (unsigned long long) ns : 0)] += 1;
+}
+
+double profiler_stats_stddev(const Profiler_Stats *stats) {
+    if (stats->count == 0) return 0;
+    return sqrt(stats->m2 / stats->count);
+}
+
+double profiler_stats_percentile(const Profiler_Stats *stats, double p) {
+    if (stats->count == 0) return 0;
+
+    // nearest rank
+    size_t rank = (size_t) ceil(p * stats->count);
+    if (rank < 1) rank = 1;
+
+    size_t seen = 0;
+    for (size_t i = 0; i < PROFILER_HISTOGRAM_BUCKETS; i++) {
+        seen += stats->histogram[i];
+        if (seen >= rank) {
+            double secs = profiler_histogram_top(i) / 1e9;
+            return secs < stats->max ? secs : stats->max;
+        }
     }
+    return stats->max;
+}
 
-    PROFILER_ASSERT(0 && "Unreachable: couldn't find a un-ended zone");
+unsigned int profiler_counters_available(void) {
+    return atomic_load(&__profiler_counters_mask);
 }
 
+size_t profiler_stats_recent(const Profiler_Stats *stats, double times[PROFILER_RECENT]) {
+    // until its gone all the way around, the oldest is at 0
+    size_t num   = stats->count < PROFILER_RECENT ? stats->count : PROFILER_RECENT;
+    size_t first = stats->count < PROFILER_RECENT ? 0 : stats->recent_next;
+    for (size_t i = 0; i < num; i++) times[i] = stats->recent[(first + i) % PROFILER_RECENT];
+    return num;
+}
 
-#define DIGITS_OF_PRECISION 3
-// how many tens digits before the '.'
-#define NUM_TENS_DIGITS 3
-// +1 for the dot
-#define PAD_DIGITS (DIGITS_OF_PRECISION + NUM_TENS_DIGITS + 1)
+double profiler_stats_ipc(const Profiler_Stats *stats) {
+    if (stats->counters[PROFILER_CYCLES] == 0) return 0;
+    return (double) stats->counters[PROFILER_INSTRUCTIONS] / stats->counters[PROFILER_CYCLES];
+}
 
-size_t profiler_strlen(const char *str) {
-    size_t n = 0;
-    while (*str++) n++;
-    return n;
+double profiler_stats_per_item(const Profiler_Stats *stats, Profiler_Counter counter) {
+    if (stats->items == 0) return 0;
+    return (double) stats->counters[counter] / stats->items;
 }
 
-void profiler_print(void) {
-    printf("Profiling Results:\n");
 
-    int max_word_length = 0;
-    for (size_t i = 0; i < __base_zones.count; i++) {
-        Profiler_Data it = __base_zones.items[i];
-        int title_len = profiler_strlen(it.title);
-        if (max_word_length < title_len) max_word_length = title_len;
+#ifdef PROFILER_COUNTERS
+
+static void profiler_counters_open(Profiler_Thread *thread) {
+    // what perf stat calls cycles, instructions, L1-dcache-load-misses, cache-misses and branch-misses
+    static const struct { unsigned int type; unsigned long long config; } events[PROFILER_NUM_COUNTERS] = {
+        [PROFILER_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        [PROFILER_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        [PROFILER_L1_MISSES]     = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                                                         | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        [PROFILER_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        [PROFILER_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    int leader = -1;
+    int error  = 0;
+    thread->num_counters = 0;
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) {
+        struct perf_event_attr attr = {0};
+        attr.size   = sizeof(attr);
+        attr.type   = events[i].type;
+        attr.config = events[i].config;
+        // only this threads own code, (perf_event_paranoid 2 allows that much)
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        thread->counter_fds[i]  = fd;
+        thread->counter_slot[i] = PROFILER_NONE;
+        if (fd < 0) {
+            error = errno;
+            continue;
+        }
+
+        if (leader < 0) leader = fd;
+        thread->counter_leader = leader;
+        thread->counter_slot[i] = thread->num_counters++;
+        atomic_fetch_or(&__profiler_counters_mask, 1u << i);
     }
 
-    for (size_t i = 0; i < __base_zones.count; i++) {
-        Profiler_Data it = __base_zones.items[i];
+    if (thread->num_counters < PROFILER_NUM_COUNTERS && !atomic_flag_test_and_set(&__profiler_counters_warned)) {
+        fprintf(stderr, "INFO: profiler: only %zu of %d hardware counters could be opened (%s), the rest will be 0\n",
+                thread->num_counters, PROFILER_NUM_COUNTERS, strerror(error));
+    }
+}
 
-        if (!it.end_set) continue;
-        float secs = elapsed_time_in_secs(it.start_time, it.end_time);
+static void profiler_counters_close(Profiler_Thread *thread) {
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) {
+        if (thread->counter_fds[i] >= 0) close(thread->counter_fds[i]);
+        thread->counter_fds[i] = -1;
+    }
+    thread->num_counters = 0;
+}
 
-        printf("|   ");
-        printf("%-*s", max_word_length, it.title);
-        printf(" : ");
-        printf("%*.*f", PAD_DIGITS, DIGITS_OF_PRECISION, secs);
-        printf("\n");
+// the ones that couldnt be opened are 0
+static void profiler_counters_read(Profiler_Thread *thread, unsigned long long counters[PROFILER_NUM_COUNTERS]) {
+    if (thread->num_counters == 0) return;
+
+    // PERF_FORMAT_GROUP gives how many, then the values
+    unsigned long long values[1 + PROFILER_NUM_COUNTERS];
+    if (read(thread->counter_leader, values, sizeof(values)) <= 0) return;
+
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) {
+        size_t slot = thread->counter_slot[i];
+        if (slot != PROFILER_NONE && slot < values[0]) counters[i] = values[1 + slot];
     }
 }
 
+#endif // PROFILER_COUNTERS
 
-void profiler_reset(void) {
-    __base_zones.count = 0;
+
+static Profiler_Thread *profiler_this_thread(void) {
+    size_t generation = atomic_load_explicit(&__profiler_generation, memory_order_acquire);
+    if (__profiler_this_thread && __profiler_this_generation == generation) return __profiler_this_thread;
+
+    Profiler_Thread *thread = calloc(1, sizeof(Profiler_Thread));
+    assert(thread != NULL && "Buy More RAM lol");
+    thread->first_root = PROFILER_NONE;
+
+    thread->zones.capacity = PROFILER_PREALLOC_ZONES;
+    thread->zones.items    = malloc(thread->zones.capacity * sizeof(*thread->zones.items));
+    assert(thread->zones.items != NULL && "Buy More RAM lol");
+#ifdef PROFILER_COUNTERS
+    profiler_counters_open(thread);
+#endif // PROFILER_COUNTERS
+
+    // once per thread, a spin lock is plenty.
+    while (atomic_flag_test_and_set_explicit(&__profiler_threads_lock, memory_order_acquire)) {}
+
+    size_t index = atomic_load_explicit(&__profiler_num_threads, memory_order_relaxed);
+    PROFILER_ASSERT(index < PROFILER_MAX_THREADS && "too many threads for the profiler");
+    thread->index = index;
+    snprintf(thread->name, sizeof(thread->name), "thread %zu", index);
+    __profiler_threads[index] = thread;
+    atomic_store_explicit(&__profiler_num_threads, index + 1, memory_order_release);
+
+    atomic_flag_clear_explicit(&__profiler_threads_lock, memory_order_release);
+
+    __profiler_this_thread     = thread;
+    __profiler_this_generation = generation;
+    return thread;
 }
-void profiler_free(void) {
-    profiler_da_free(&__base_zones);
+
+static void profiler_trace_push(_Atomic(Profiler_Trace_Chunk *) *list, Profiler_Trace_Chunk *chunk) {
+    Profiler_Trace_Chunk *head = atomic_load(list);
+    do {
+        chunk->next = head;
+    } while (!atomic_compare_exchange_weak(list, &head, chunk));
+}
+
+static void profiler_trace_add(Profiler_Thread *thread, const Profiler_Site *site, time_unit start, time_unit end) {
+    Profiler_Trace_Chunk *chunk = thread->trace;
+
+    if (chunk == NULL) {
+        // one the writer is done with, if theres any.
+        if (thread->spares == NULL) thread->spares = atomic_exchange(&thread->returned, NULL);
+        chunk = thread->spares;
+        if (chunk) thread->spares = chunk->next;
+
+        if (chunk == NULL) {
+            chunk = malloc(sizeof(Profiler_Trace_Chunk));
+            assert(chunk != NULL && "Buy More RAM lol");
+        }
+        chunk->thread = thread->index;
+        chunk->count  = 0;
+        thread->trace = chunk;
+    }
+
+    chunk->events[chunk->count++] = (Profiler_Trace_Event){
+        .site       = site,
+        .start_time = start,
+        .end_time   = end,
+    };
+
+    if (chunk->count == PROFILER_TRACE_CHUNK) {
+        profiler_trace_push(&__profiler_trace.full, chunk);
+        thread->trace = NULL;
+    }
+}
+
+static void profiler_trace_write_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (; *string; string++) {
+        if (*string == '"' || *string == '\\') fputc('\\', file);
+        if ((unsigned char) *string < ' ') continue;
+        fputc(*string, file);
+    }
+    fputc('"', file);
 }
 
+static void profiler_trace_write_chunk(Profiler_Trace_Chunk *chunk) {
+    Profiler_Trace *trace = &__profiler_trace;
+
+    for (size_t i = 0; i < chunk->count; i++) {
+        Profiler_Trace_Event event = chunk->events[i];
+
+        // started before the trace did
+        double ts = elapsed_time_in_secs(trace->start_time, event.start_time) * 1e6;
+        if (ts < 0) continue;
+        double dur = elapsed_time_in_secs(event.start_time, event.end_time) * 1e6;
+
+        fprintf(trace->file, "%s\n{\"name\":", trace->first ? "" : ",");
+        profiler_trace_write_string(trace->file, event.site->title);
+        fprintf(trace->file, ",\"cat\":\"zone\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%zu,\"args\":{\"file\":",
+                ts, dur, chunk->thread);
+        profiler_trace_write_string(trace->file, event.site->file);
+        fprintf(trace->file, ",\"line\":%d}}", event.site->line);
+        trace->first = 0;
+    }
+}
+
+// takes everything off 'full', and writes it oldest first.
+static int profiler_trace_write_full(void) {
+    Profiler_Trace_Chunk *chunks = atomic_exchange(&__profiler_trace.full, NULL);
+    if (chunks == NULL) return 0;
+
+    // its a stack, newest first
+    Profiler_Trace_Chunk *reversed = NULL;
+    while (chunks) {
+        Profiler_Trace_Chunk *next = chunks->next;
+        chunks->next = reversed;
+        reversed = chunks;
+        chunks = next;
+    }
+
+    while (reversed) {
+        Profiler_Trace_Chunk *next = reversed->next;
+        profiler_trace_write_chunk(reversed);
+        profiler_trace_push(&__profiler_threads[reversed->thread]->returned, reversed);
+        reversed = next;
+    }
+    return 1;
+}
+
+static void *profiler_trace_writer(void *args) {
+    (void) args;
+
+    while (1) {
+        // read 'stopping' first, so nothing pushed before it was set gets left behind.
+        int stopping = atomic_load(&__profiler_trace.stopping);
+        if (profiler_trace_write_full()) continue;
+        if (stopping) break;
+
+        // no hurry, the chunks wait
+        struct timespec wait = { .tv_sec = 0, .tv_nsec = 5 * 1000 * 1000 };
+        nanosleep(&wait, NULL);
+    }
+
+    return NULL;
+}
+
+int profiler_trace_start(const char *path) {
+    Profiler_Trace *trace = &__profiler_trace;
+    if (atomic_load(&trace->on)) profiler_trace_stop();
+
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) return 0;
+
+    // the writer only ever writes to this, so it can be big.
+    size_t buffer_size = 1 << 20;
+    trace->file_buffer = malloc(buffer_size);
+    assert(trace->file_buffer != NULL && "Buy More RAM lol");
+    setvbuf(trace->file, trace->file_buffer, _IOFBF, buffer_size);
+
+    fprintf(trace->file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    trace->first = 1;
+    trace->start_time = get_time();
+
+    atomic_store(&trace->stopping, 0);
+    int res = pthread_create(&trace->writer, NULL, profiler_trace_writer, NULL);
+    if (res) {
+        fprintf(stderr, "ERROR: trace writer thread could not be created\n");
+        exit(1);
+    }
+
+    atomic_store(&trace->on, 1);
+    return 1;
+}
+
+void profiler_trace_stop(void) {
+    Profiler_Trace *trace = &__profiler_trace;
+    if (!atomic_load(&trace->on)) return;
+    atomic_store(&trace->on, 0);
+
+    // the half full ones
+    size_t num_threads = atomic_load_explicit(&__profiler_num_threads, memory_order_acquire);
+    for (size_t i = 0; i < num_threads; i++) {
+        Profiler_Thread *thread = __profiler_threads[i];
+        if (thread->trace == NULL) continue;
+
+        profiler_trace_push(&trace->full, thread->trace);
+        thread->trace = NULL;
+    }
+
+    atomic_store(&trace->stopping, 1);
+    pthread_join(trace->writer, NULL);
 
-int maybe_index_in_array(Profiler_Data_Array array, Profiler_Data checking) {
-    for (size_t i = 0; i < array.count; i++) {
-        Profiler_Data item = array.items[i];
-        if (profiler_equal(item, checking)) {
-            return i;
+    // the names of the threads
+    for (size_t i = 0; i < num_threads; i++) {
+        fprintf(trace->file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":",
+                trace->first ? "" : ",", i);
+        profiler_trace_write_string(trace->file, __profiler_threads[i]->name);
+        fprintf(trace->file, "}}");
+        trace->first = 0;
+    }
+    fprintf(trace->file, "\n]");
+
+    // not part of the format, the viewers skip it, but its handy for scripts.
+    fprintf(trace->file, ",\"zoneStats\":[");
+    Profiler_Stats_Array stats = profiler_stats();
+    for (size_t i = 0; i < stats.count; i++) {
+        Profiler_Stats *it = stats.items[i];
+        fprintf(trace->file, "%s\n{\"name\":", i ? "," : "");
+        profiler_trace_write_string(trace->file, it->title);
+        fprintf(trace->file, ",\"tid\":%zu,\"depth\":%zu,\"count\":%zu,\"mean_ms\":%.6f,\"stddev_ms\":%.6f,"
+                             "\"p50_ms\":%.6f,\"p95_ms\":%.6f,\"p99_ms\":%.6f,\"max_ms\":%.6f,\"budget_misses\":%zu",
+                it->thread, it->depth, it->count, it->mean * 1e3, profiler_stats_stddev(it) * 1e3,
+                profiler_stats_percentile(it, 0.50) * 1e3, profiler_stats_percentile(it, 0.95) * 1e3,
+                profiler_stats_percentile(it, 0.99) * 1e3, it->max * 1e3, it->budget_misses);
+
+        double recent[PROFILER_RECENT];
+        size_t num_recent = profiler_stats_recent(it, recent);
+        fprintf(trace->file, ",\"recent_ms\":[");
+        for (size_t j = 0; j < num_recent; j++) fprintf(trace->file, "%s%.6f", j ? "," : "", recent[j] * 1e3);
+        fprintf(trace->file, "]");
+
+        if (profiler_counters_available()) {
+            fprintf(trace->file, ",\"items\":%llu,\"ipc\":%.4f", it->items, profiler_stats_ipc(it));
+            for (size_t j = 0; j < PROFILER_NUM_COUNTERS; j++) {
+                fprintf(trace->file, ",\"%s\":%llu,\"%s_per_item\":%.6f",
+                        profiler_counter_names[j], it->counters[j],
+                        profiler_counter_names[j], profiler_stats_per_item(it, j));
+            }
+        }
+        fprintf(trace->file, "}");
+    }
+    fprintf(trace->file, "\n]}\n");
+
+    fclose(trace->file);
+    free(trace->file_buffer);
+    trace->file = NULL;
+    trace->file_buffer = NULL;
+
+    for (size_t i = 0; i < num_threads; i++) {
+        Profiler_Thread *thread = __profiler_threads[i];
+        Profiler_Trace_Chunk *lists[2] = { thread->spares, atomic_exchange(&thread->returned, NULL) };
+        thread->spares = NULL;
+
+        for (size_t j = 0; j < 2; j++) {
+            Profiler_Trace_Chunk *chunk = lists[j];
+            while (chunk) {
+                Profiler_Trace_Chunk *next = chunk->next;
+                free(chunk);
+                chunk = next;
+            }
         }
     }
-    return -1;
 }
 
-Profiler_Stats_Array collect_stats(void) {
-    Profiler_Stats_Array result = {0};     // linked arrays
-    Profiler_Data_Array unique_data = {0}; // linked arrays
+int profiler_tracing(void) {
+    return atomic_load(&__profiler_trace.on);
+}
+
+
+void profiler_zone_items(unsigned long long items) {
+    Profiler_Thread *thread = profiler_this_thread();
+    PROFILER_ASSERT(thread->depth > 0 && "PROFILER_ZONE_ITEMS() outside of a zone");
+    thread->zones.items[thread->open[thread->depth - 1].zone].items += items;
+}
+
+void profiler_name_thread(const char *name) {
+    Profiler_Thread *thread = profiler_this_thread();
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+
+// profile the things after this call
+// will stop with profiler_end_zone
+void profiler_zone(const Profiler_Site *site) {
+    Profiler_Thread *thread = profiler_this_thread();
+    PROFILER_ASSERT(thread->depth < PROFILER_MAX_DEPTH && "zones are nested too deep");
+
+    size_t parent = thread->depth ? thread->open[thread->depth - 1].zone : PROFILER_NONE;
 
-    for (size_t i = 0; i < __base_zones.count; i++) {
-        Profiler_Data it = __base_zones.items[i];
+    size_t zone = thread->last[thread->depth];
+    if (zone >= thread->zones.count || thread->zones.items[zone].site != site || thread->zones.items[zone].parent != parent) {
+        size_t first = parent == PROFILER_NONE ? thread->first_root : thread->zones.items[parent].first_child;
 
-        if (!it.end_set) continue;
-        // check weather this data is in the unique data array.
-        int maybe_index = maybe_index_in_array(unique_data, it);
+        // has it been here, inside this parent, before?
+        zone = first;
+        while (zone != PROFILER_NONE && thread->zones.items[zone].site != site) {
+            zone = thread->zones.items[zone].next_sibling;
+        }
 
-        if (maybe_index == -1) {
-            // its not in the array.
-            Profiler_Stats new_stats = {
-                .title = it.title,
-                .file  = it.file,
-                .line  = it.line,
+        if (zone == PROFILER_NONE) {
+            Profiler_Stats new_zone = {
+                .title = site->title,
+                .file  = site->file,
+                .line  = site->line,
+                .site  = site,
+
+                .thread = thread->index,
+                .depth  = thread->depth,
+                .parent = parent,
+                .first_child  = PROFILER_NONE,
+                .next_sibling = first,
             };
+            zone = thread->zones.count;
+            profiler_da_append(&thread->zones, new_zone);
 
-            profiler_da_append(&unique_data, it);
-            profiler_da_append(&result, new_stats);
-            maybe_index = unique_data.count-1;
+            if (parent == PROFILER_NONE) thread->first_root = zone;
+            else thread->zones.items[parent].first_child = zone;
         }
+        thread->last[thread->depth] = zone;
+    }
 
-        Profiler_Stats *stats = &result.items[maybe_index];
-        double time = elapsed_time_in_secs(it.start_time, it.end_time);
-        profiler_da_append(&stats->times, time);
+    Profiler_Open *open = &thread->open[thread->depth++];
+    open->zone = zone;
+#ifdef PROFILER_COUNTERS
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) open->counters[i] = 0;
+    profiler_counters_read(thread, open->counters);
+#endif // PROFILER_COUNTERS
+    // last, so the time it took to get here isnt counted
+    open->start_time = get_time();
+}
+
+void profiler_zone_end(void) {
+    time_unit end = get_time();
+
+    Profiler_Thread *thread = profiler_this_thread();
+    PROFILER_ASSERT(thread->depth > 0 && "Unreachable: couldn't find a un-ended zone");
+    Profiler_Open open = thread->open[--thread->depth];
+
+#ifdef PROFILER_COUNTERS
+    unsigned long long counters[PROFILER_NUM_COUNTERS] = {0};
+    profiler_counters_read(thread, counters);
+    for (size_t i = 0; i < PROFILER_NUM_COUNTERS; i++) {
+        thread->zones.items[open.zone].counters[i] += counters[i] - open.counters[i];
     }
+#endif // PROFILER_COUNTERS
 
-    profiler_da_free(&unique_data);
-    return result;
+    profiler_stats_add(&thread->zones.items[open.zone], elapsed_time_in_secs(open.start_time, end));
+
+    if (atomic_load_explicit(&__profiler_trace.on, memory_order_relaxed)) {
+        profiler_trace_add(thread, thread->zones.items[open.zone].site, open.start_time, end);
+    }
 }
 
-size_t profiler_zone_count(void) {
-    return __base_zones.count;
+
+#define DIGITS_OF_PRECISION 3
+// how many tens digits before the '.'
+#define NUM_TENS_DIGITS 3
+// +1 for the dot
+#define PAD_DIGITS (DIGITS_OF_PRECISION + NUM_TENS_DIGITS + 1)
+
+size_t profiler_strlen(const char *str) {
+    size_t n = 0;
+    while (*str++) n++;
+    return n;
 }
 
+// the children are in the order they were added, newest first, so this puts them back.
+static void profiler_collect_zone(Profiler_Thread *thread, size_t zone) {
+    if (zone == PROFILER_NONE) return;
+    profiler_collect_zone(thread, thread->zones.items[zone].next_sibling);
+
+    Profiler_Stats *stats = &thread->zones.items[zone];
+    stats->thread_name = thread->name;
+    profiler_da_append(&__profiler_collected, stats);
 
-// TODO move this
-typedef struct Numerical_Average_Bounds {
-    double sample_mean;
-    double standard_deviation;
-    double standard_error;
-    double confidence_interval_upper;
-    double confidence_interval_lower;
-} Numerical_Average_Bounds;
+    profiler_collect_zone(thread, stats->first_child);
+}
 
+Profiler_Stats_Array profiler_stats(void) {
+    __profiler_collected.count = 0;
 
+    size_t num_threads = atomic_load_explicit(&__profiler_num_threads, memory_order_acquire);
+    for (size_t i = 0; i < num_threads; i++) {
+        profiler_collect_zone(__profiler_threads[i], __profiler_threads[i]->first_root);
+    }
 
-#include <math.h>
+    return __profiler_collected;
+}
 
-Numerical_Average_Bounds get_numerical_average(Double_Array numbers) {
-    double sample_mean = 0;
-    for (size_t i = 0; i < numbers.count; i++) {
-        // TODO? use https://en.wikipedia.org/wiki/Kahan_summation_algorithm
-        sample_mean += numbers.items[i];;
+
+void profiler_print(void) {
+    printf("Profiling Results:\n");
+    Profiler_Stats_Array stats = profiler_stats();
+
+    int max_word_length = 0;
+    for (size_t i = 0; i < stats.count; i++) {
+        Profiler_Stats *it = stats.items[i];
+        int title_len = profiler_strlen(it->title) + 2*it->depth;
+        if (max_word_length < title_len) max_word_length = title_len;
     }
-    sample_mean /= numbers.count;
 
-    double standard_deviation = 0;
-    for (size_t i = 0; i < numbers.count; i++) {
-        double it = numbers.items[i];
+    size_t last_thread = PROFILER_NONE;
+    for (size_t i = 0; i < stats.count; i++) {
+        Profiler_Stats *it = stats.items[i];
+        if (it->count == 0) continue;
+
+        if (it->thread != last_thread) {
+            printf("| %s\n", it->thread_name);
+            last_thread = it->thread;
+        }
 
-        // TODO? use https://en.wikipedia.org/wiki/Kahan_summation_algorithm
-        standard_deviation += (it - sample_mean)*(it - sample_mean);
+        printf("|   ");
+        printf("%*s%-*s", (int) (2*it->depth), "", (int) (max_word_length - 2*it->depth), it->title);
+        printf(" : ");
+        printf("%*.*f +- %*.*f", PAD_DIGITS, DIGITS_OF_PRECISION, it->mean, PAD_DIGITS, DIGITS_OF_PRECISION, profiler_stats_stddev(it));
+        printf(" (p50 %.*f, p95 %.*f, p99 %.*f, max %.*f, %zu times, %zu over budget)",
+               DIGITS_OF_PRECISION, profiler_stats_percentile(it, 0.50),
+               DIGITS_OF_PRECISION, profiler_stats_percentile(it, 0.95),
+               DIGITS_OF_PRECISION, profiler_stats_percentile(it, 0.99),
+               DIGITS_OF_PRECISION, it->max, it->count, it->budget_misses);
+        printf("\n");
+
+        if (profiler_counters_available()) {
+            printf("|   %*s  ipc %.2f", (int) max_word_length, "", profiler_stats_ipc(it));
+            if (it->items) {
+                printf(", per item: %.3f l1 misses, %.3f llc misses, %.3f branch misses",
+                       profiler_stats_per_item(it, PROFILER_L1_MISSES),
+                       profiler_stats_per_item(it, PROFILER_LLC_MISSES),
+                       profiler_stats_per_item(it, PROFILER_BRANCH_MISSES));
+            }
+            printf("\n");
+        }
     }
-    standard_deviation /= numbers.count;
-
-    return (Numerical_Average_Bounds){
-        .sample_mean = sample_mean,
-        .standard_deviation = standard_deviation,
-        .standard_error = standard_deviation / numbers.count,
-        .confidence_interval_upper = sample_mean + 0.95 * (standard_deviation / sqrt(numbers.count)),
-        .confidence_interval_lower = sample_mean - 0.95 * (standard_deviation / sqrt(numbers.count)),
-    };
+}
+
+
+// forgets the times, but not the zones
+void profiler_reset(void) {
+    size_t num_threads = atomic_load_explicit(&__profiler_num_threads, memory_order_acquire);
+    for (size_t i = 0; i < num_threads; i++) {
+        Profiler_Thread *thread = __profiler_threads[i];
+        for (size_t j = 0; j < thread->zones.count; j++) profiler_stats_clear(&thread->zones.items[j]);
+    }
+}
+void profiler_free(void) {
+    profiler_trace_stop();
+
+    size_t num_threads = atomic_load_explicit(&__profiler_num_threads, memory_order_acquire);
+    for (size_t i = 0; i < num_threads; i++) {
+#ifdef PROFILER_COUNTERS
+        profiler_counters_close(__profiler_threads[i]);
+#endif // PROFILER_COUNTERS
+        profiler_da_free(&__profiler_threads[i]->zones);
+        free(__profiler_threads[i]);
+        __profiler_threads[i] = NULL;
+    }
+    atomic_store(&__profiler_num_threads, 0);
+    // every thread makes a new one next time
+    atomic_fetch_add(&__profiler_generation, 1);
+
+    profiler_da_free(&__profiler_collected);
 }
 
 
@@ -0,0 +1,290 @@
+//
+// render.c - render the animation to image files, with no window
+//
+// the same points bouncing around as main.c, but with a fixed timestep and our
+// own random, so the same seed always gives the same frames. every frame is
+// computed by one of the CPU backends, (like bench.c, they are all linked in)
+// and handed to frame_writer.h, which writes it on its own thread while the
+// next one is being computed. no raylib, no GPU, so it runs anywhere.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
+
+#define THREAD_POOL_IMPLEMENTATION
+#include "thread_pool.h"
+
+#define FRAME_WRITER_IMPLEMENTATION
+#include "frame_writer.h"
+
+#define SEED_FILE_IMPLEMENTATION
+#include "seed_file.h"
+
+#define BACKENDS_IMPLEMENTATION
+#include "backends.h"
+
+#include "voronoi_compute.h"
+
+
+Point       *points_pos    = 0;
+Point       *points_vel    = 0;
+Frame_Color *points_colors = 0;
+
+// the same as raylib's ColorFromHSV()
+Frame_Color color_from_hsv(float hue, float saturation, float value) {
+    float channels[3];
+    float offsets[3] = {5.0f, 3.0f, 1.0f};
+
+    for (int i = 0; i < 3; i++) {
+        float k = fmodf(offsets[i] + hue/60.0f, 6);
+        float t = 4.0f - k;
+        k = (t < k) ? t : k;
+        k = (k < 1) ? k : 1;
+        k = (k > 0) ? k : 0;
+        channels[i] = (value - value*saturation*k) * 255.0f;
+    }
+
+    return (Frame_Color){channels[0], channels[1], channels[2], 255};
+}
+
+// like add_new_point() in main.c
+void make_points(u64 num_points, u64 width, u64 height) {
+    points_pos    = malloc(num_points * sizeof(Point));
+    points_vel    = malloc(num_points * sizeof(Point));
+    points_colors = malloc(num_points * sizeof(Frame_Color));
+    assert((num_points == 0 || (points_pos && points_vel && points_colors)) && "Buy More RAM lol");
+
+    for (u64 i = 0; i < num_points; i++) {
+        Point pos = {rng_float() * width, rng_float() * height};
+        Point vel = random_velocity();
+
+        points_pos   [i] = pos;
+        points_vel   [i] = vel;
+        points_colors[i] = color_from_hsv(rng_float() * 360, 0.7, 0.7);
+    }
+}
+
+// the points from a file, (see seed_file.h) with random velocities like make_points().
+// the number of points, or -1 if it couldnt be loaded.
+s64 load_points(const char *path, u64 width, u64 height) {
+    Seed_File file;
+    if (!seed_file_open(&file, path)) return -1;
+
+    u64 num_points = file.count;
+    points_pos    = malloc(num_points * sizeof(Point));
+    points_vel    = malloc(num_points * sizeof(Point));
+    points_colors = malloc(num_points * sizeof(Frame_Color));
+    assert((num_points == 0 || (points_pos && points_vel && points_colors)) && "Buy More RAM lol");
+
+    seed_file_read(&file, (float *) points_pos, (u8 *) points_colors, width, height);
+    seed_file_close(&file);
+
+    for (u64 i = 0; i < num_points; i++) {
+        points_vel[i] = random_velocity();
+    }
+
+    return num_points;
+}
+
+typedef struct Walk {
+    u64 width, height;
+} Walk;
+
+// walk_points() on the pool threads
+void walk_chunk(void *data, u64 start, u64 end, u64 thread) {
+    (void) thread;
+    Walk *walk = data;
+    walk_points(points_pos, points_vel, start, end, walk->width, walk->height);
+}
+
+
+void usage(FILE *stream, const char *program) {
+    fprintf(stream, "USAGE: %s --out DIR [OPTIONS]\n", program);
+    fprintf(stream, "    --out DIR            where the frames go, (made if its not there)\n");
+    fprintf(stream, "    --frames N           how many frames (default: 60)\n");
+    fprintf(stream, "    --size WxH           the size of the frames (default: 1920x1080)\n");
+    fprintf(stream, "    --points N           how many points (default: 10)\n");
+    fprintf(stream, "    --load FILE          the points from FILE instead, (.csv/.txt, or packed f32 x, y pairs)\n");
+    fprintf(stream, "    --seed S             random seed (default: 1)\n");
+    fprintf(stream, "    --backend NAME       which CPU backend (default: simple_threaded)\n");
+    fprintf(stream, "    --format FORMAT      ppm or qoi (default: qoi)\n");
+    fprintf(stream, "    --threads N          threads for the threaded backends (default: one per core)\n");
+    fprintf(stream, "    --trace FILE         write the profiler zones to FILE, as a Chrome trace\n");
+}
+
+
+int main(int argc, char const **argv) {
+    const char *program = argv[0];
+
+    const char *out_dir      = NULL;
+    const char *backend_name = "simple_threaded";
+    const char *format_name  = "qoi";
+    const char *trace_path   = NULL;
+    const char *load_path    = NULL;
+    u64 num_frames = 60;
+    u64 width      = 1920;
+    u64 height     = 1080;
+    u64 num_points = 10;
+    u64 seed       = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            usage(stdout, program);
+            return 0;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "ERROR: '%s' needs an argument, or is unknown\n", arg);
+            usage(stderr, program);
+            return 1;
+        }
+        const char *value = argv[++i];
+
+        if      (strcmp(arg, "--out")     == 0) out_dir      = value;
+        else if (strcmp(arg, "--frames")  == 0) num_frames   = atol(value);
+        else if (strcmp(arg, "--points")  == 0) num_points   = atol(value);
+        else if (strcmp(arg, "--seed")    == 0) seed         = atol(value);
+        else if (strcmp(arg, "--backend") == 0) backend_name = value;
+        else if (strcmp(arg, "--format")  == 0) format_name  = value;
+        else if (strcmp(arg, "--trace")   == 0) trace_path   = value;
+        else if (strcmp(arg, "--load")    == 0) load_path    = value;
+        // pool_start() reads this
+        else if (strcmp(arg, "--threads") == 0) setenv("VORONOI_THREADS", value, 1);
+        else if (strcmp(arg, "--size")    == 0) {
+            if (sscanf(value, "%zux%zu", &width, &height) != 2 || width == 0 || height == 0) {
+                fprintf(stderr, "ERROR: '%s' is not a size, it should look like 1920x1080\n", value);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+            usage(stderr, program);
+            return 1;
+        }
+    }
+
+    if (!out_dir) {
+        fprintf(stderr, "ERROR: no --out directory\n");
+        usage(stderr, program);
+        return 1;
+    }
+
+    Backend *backend = find_backend(backend_name);
+    if (!backend) {
+        fprintf(stderr, "ERROR: unknown backend '%s'\n", backend_name);
+        return 1;
+    }
+
+    Frame_Format format = NUM_FRAME_FORMATS;
+    for (u64 f = 0; f < NUM_FRAME_FORMATS; f++) {
+        if (strcmp(frame_format_names[f], format_name) == 0) format = f;
+    }
+    if (format == NUM_FRAME_FORMATS) {
+        fprintf(stderr, "ERROR: unknown format '%s', its ppm or qoi\n", format_name);
+        return 1;
+    }
+
+    if (mkdir(out_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: could not make '%s': %s\n", out_dir, strerror(errno));
+        return 1;
+    }
+
+
+    PROFILER_NAME_THREAD("main thread");
+    if (trace_path) {
+        if (!profiler_trace_start(trace_path)) {
+            fprintf(stderr, "ERROR: could not open '%s'\n", trace_path);
+            return 1;
+        }
+    }
+
+    rng_state = seed;
+
+    // before the backend, so it gets the same threads. (and before the loading, it uses them)
+    pool_start();
+
+    if (load_path) {
+        time_unit load_start = get_time();
+        s64 loaded = load_points(load_path, width, height);
+        if (loaded < 0) {
+            pool_stop();
+            PROFILER_FREE();
+            return 1;
+        }
+        num_points = loaded;
+        printf("INFO: loaded %zu points from %s in %.3f s\n", num_points, load_path, elapsed_time_in_secs(load_start, get_time()));
+    } else {
+        make_points(num_points, width, height);
+    }
+    backend->init();
+
+    Frame_Writer writer;
+    frame_writer_start(&writer, out_dir, format, width, height);
+
+    Walk walk = {width, height};
+
+    time_unit start = get_time();
+    double compute_secs = 0;
+
+    u64 frame = 0;
+    for (; frame < num_frames; frame++) {
+        if (frame_writer_error(&writer)) break;
+
+        // waits until the writer is done with the one from two frames ago
+        u32 *labels = frame_writer_begin(&writer);
+
+        time_unit compute_start = get_time();
+        PROFILER_ZONE("compute");
+            backend->compute(labels, width, height, (float *) points_pos, num_points);
+            PROFILER_ZONE_ITEMS(width * height);
+        PROFILER_ZONE_END();
+        compute_secs += elapsed_time_in_secs(compute_start, get_time());
+
+        frame_writer_end(&writer, frame, points_colors, num_points);
+
+        PROFILER_ZONE("walk points");
+            pool_for(num_points, 4096, walk_chunk, &walk);
+        PROFILER_ZONE_END();
+    }
+
+    int error = frame_writer_stop(&writer);
+    // the writer thread is gone, so no lock
+    u64 frames_written = writer.frames_written;
+    u64 bytes_written  = writer.bytes_written;
+
+    double total_secs = elapsed_time_in_secs(start, get_time());
+
+    backend->finish();
+    pool_stop();
+
+    free(points_pos);
+    free(points_vel);
+    free(points_colors);
+
+    if (error) {
+        fprintf(stderr, "ERROR: could not write the frames to '%s': %s\n", out_dir, strerror(error));
+        PROFILER_FREE();
+        return 1;
+    }
+
+    printf("INFO: %zu frames of %zux%zu, %zu points, in %.3f s (%.3f ms per frame, %.3f ms of that computing)\n",
+           frames_written, width, height, num_points, total_secs,
+           frames_written ? total_secs * 1e3 / frames_written : 0,
+           frame ? compute_secs * 1e3 / frame : 0);
+    printf("INFO: %.1f MB of %s in '%s'\n", bytes_written / 1e6, frame_format_names[format], out_dir);
+
+    // (this writes the rest of the trace)
+    PROFILER_FREE();
+    return 0;
+}
@@ -0,0 +1,469 @@
+//
+// seed_coherence.h - start every tile from last frame's labels, and prove it cant be anything else
+//
+// the points only move a few pixels a frame, so a tile of pixels is almost
+// always owned by the same few points as last frame. so for every tile:
+//
+// 1. Take the points that owned the tile last frame, and the ones that owned
+//    the pixels just around it. (the neighbours, that could move in)
+// 2. Find the closest of those for every pixel with seed_soa_rect(),
+//    and how far the furthest pixel is from its point, 'r'.
+// 3. The real closest point of every pixel is at most 'r' away from it,
+//    so its in the grid, no more than 'r' away from the tile. (and no more
+//    than that rows 'r' away from its row) if all of those were in step 1,
+//    thats the answer.
+// 4. Otherwise add them, and do step 2 again.
+//
+// without a last frame, step 1 is the point closest to the middle of the tile.
+//
+// a tile only has to be done again if a point that moved, came or went, was
+// (or is now) no further from it than its furthest pixel was from its point.
+// all the others keep their labels, so when nothing moves, nothing is done.
+//
+// gives the exact same answer as checking every point, ties included,
+// (the lowest index wins) so its a drop in for the brute force loops.
+//
+// everything in here is static, every backend gets its own copy.
+// (the bench links them all into the one binary)
+//
+
+#ifndef SEED_COHERENCE_H_
+#define SEED_COHERENCE_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "ints.h"
+#include "seed_grid.h"
+#include "seed_soa.h"
+
+// the size of the tiles, the rectangles given to seed_coherence_rect() have to be these.
+#define SEED_COHERENCE_TILE 16
+
+// how far around the tile to look for last frame's points, in pixels.
+#define SEED_COHERENCE_BORDER 4
+
+typedef struct Seed_Coherence {
+    // last frame's labels, and this frame's. they swap every frame,
+    // so a tile can read around itself while the others are being written.
+    u32 *labels[2];
+    u64 current;
+    u64 capacity;
+
+    u64 width, height;
+    u64 num_points;
+    // the old labels are from the same sized screen, and the same points.
+    bool has_history;
+
+    // where the points were last frame
+    float *points;
+    u64 point_capacity;
+
+    // for every tile, how far its furthest pixel was from its point,
+    // and if it has to be done again this frame.
+    float *tile_r;
+    bool  *tile_dirty;
+    u64 tiles_x, tiles_y;
+    u64 tile_capacity;
+    u64 num_dirty;
+
+    // every row of pixels with a dirty tile on it, for present_labels_rows()
+    bool *row_dirty;
+    u64 row_capacity;
+} Seed_Coherence;
+
+// every thread needs its own.
+typedef struct Seed_Coherence_Scratch {
+    // the points being checked, sorted by index, (for the ties) and their indexes.
+    Seed_Soa soa;
+    u32 *ids;
+    u64 ids_capacity;
+
+    // the points of steps 1 and 3, before they go in the soa.
+    u32 *near;
+    u64 near_count;
+    u64 near_capacity;
+
+    // when stamps[k] == stamp, point k is already in 'near'.
+    u32 *stamps;
+    u64 stamps_capacity;
+    u32 stamp;
+
+    // what seed_soa_rect() gives back, for the whole tile.
+    u32 *tile;
+    u64 tile_capacity;
+    // the 'r' of every row of the tile, squared
+    float *row_r;
+    u64 row_r_capacity;
+} Seed_Coherence_Scratch;
+
+
+// the tiles that a point at (x, y) could have taken pixels from, or could take pixels from now.
+static void seed_coherence_touch(Seed_Coherence *coherence, float x, float y, float max_r) {
+    // no telling where NaN's go
+    if (isnan(x) || isnan(y)) {
+        for (u64 t = 0; t < coherence->tiles_x * coherence->tiles_y; t++) coherence->tile_dirty[t] = true;
+        return;
+    }
+
+    float reach = max_r + SEED_GRID_EPSILON;
+    float tx0 = floorf((x - reach) / SEED_COHERENCE_TILE), tx1 = floorf((x + reach) / SEED_COHERENCE_TILE);
+    float ty0 = floorf((y - reach) / SEED_COHERENCE_TILE), ty1 = floorf((y + reach) / SEED_COHERENCE_TILE);
+    // off the screen, (or past the end of a float) nothing there.
+    if (tx1 < 0 || ty1 < 0 || tx0 >= coherence->tiles_x || ty0 >= coherence->tiles_y) return;
+    if (tx0 < 0) tx0 = 0;
+    if (ty0 < 0) ty0 = 0;
+    if (tx1 >= coherence->tiles_x) tx1 = coherence->tiles_x - 1;
+    if (ty1 >= coherence->tiles_y) ty1 = coherence->tiles_y - 1;
+
+    for (u64 ty = ty0; ty <= (u64) ty1; ty++) {
+        for (u64 tx = tx0; tx <= (u64) tx1; tx++) {
+            u64 t = ty*coherence->tiles_x + tx;
+            if (coherence->tile_dirty[t]) continue;
+
+            // same as seed_coherence_gather()
+            float left = tx*SEED_COHERENCE_TILE, right  = fminf(left + SEED_COHERENCE_TILE, coherence->width)  - 1;
+            float top  = ty*SEED_COHERENCE_TILE, bottom = fminf(top  + SEED_COHERENCE_TILE, coherence->height) - 1;
+            float dx = x < left ? left - x : x > right  ? x - right  : 0;
+            float dy = y < top  ? top  - y : y > bottom ? y - bottom : 0;
+            float r  = coherence->tile_r[t] + SEED_GRID_EPSILON;
+
+            if (dx*dx + dy*dy <= r*r) coherence->tile_dirty[t] = true;
+        }
+    }
+}
+
+// call once a frame, before seed_coherence_rect().
+static void seed_coherence_begin(Seed_Coherence *coherence, const float *points, u64 num_points, u64 width, u64 height) {
+    coherence->has_history = coherence->labels[0] != NULL
+                          && coherence->width  == width
+                          && coherence->height == height;
+
+    if (coherence->capacity < width * height) {
+        coherence->capacity = width * height;
+        for (u64 i = 0; i < 2; i++) {
+            free(coherence->labels[i]);
+            coherence->labels[i] = malloc(coherence->capacity * sizeof(u32));
+            assert(coherence->labels[i] != NULL && "Buy More RAM lol");
+        }
+        coherence->has_history = false;
+    }
+
+    u64 tiles_x = (width  + SEED_COHERENCE_TILE - 1) / SEED_COHERENCE_TILE;
+    u64 tiles_y = (height + SEED_COHERENCE_TILE - 1) / SEED_COHERENCE_TILE;
+    if (coherence->tile_capacity < tiles_x * tiles_y) {
+        coherence->tile_capacity = tiles_x * tiles_y;
+        free(coherence->tile_r);
+        free(coherence->tile_dirty);
+        coherence->tile_r     = malloc(coherence->tile_capacity * sizeof(float));
+        coherence->tile_dirty = malloc(coherence->tile_capacity * sizeof(bool));
+        assert(coherence->tile_r && coherence->tile_dirty && "Buy More RAM lol");
+        coherence->has_history = false;
+    }
+    if (coherence->row_capacity < height) {
+        coherence->row_capacity = height;
+        free(coherence->row_dirty);
+        coherence->row_dirty = malloc(coherence->row_capacity * sizeof(bool));
+        assert(coherence->row_dirty != NULL && "Buy More RAM lol");
+    }
+    coherence->tiles_x = tiles_x;
+    coherence->tiles_y = tiles_y;
+    u64 num_tiles = tiles_x * tiles_y;
+
+
+    // what moved, came or went since last frame
+    u64 old_num_points = coherence->num_points;
+    u64 same_points = num_points < old_num_points ? num_points : old_num_points;
+    u64 changes = 0;
+    if (coherence->has_history) {
+        for (u64 k = 0; k < same_points; k++) {
+            // != so NaN's count as moving
+            changes += points[2*k] != coherence->points[2*k] || points[2*k + 1] != coherence->points[2*k + 1];
+        }
+        changes += num_points > old_num_points ? num_points - old_num_points : old_num_points - num_points;
+    }
+
+    bool all_dirty = !coherence->has_history || changes >= num_tiles;
+    for (u64 t = 0; t < num_tiles; t++) coherence->tile_dirty[t] = all_dirty;
+
+    if (!all_dirty && changes > 0) {
+        float max_r = 0;
+        for (u64 t = 0; t < num_tiles; t++) max_r = fmaxf(max_r, coherence->tile_r[t]);
+
+        const float *old_points = coherence->points;
+        for (u64 k = 0; k < same_points; k++) {
+            if (points[2*k] == old_points[2*k] && points[2*k + 1] == old_points[2*k + 1]) continue;
+            // where it was, and where it is
+            seed_coherence_touch(coherence, old_points[2*k], old_points[2*k + 1], max_r);
+            seed_coherence_touch(coherence, points[2*k],     points[2*k + 1],     max_r);
+        }
+        // the ones that are gone
+        for (u64 k = same_points; k < old_num_points; k++) seed_coherence_touch(coherence, old_points[2*k], old_points[2*k + 1], max_r);
+        // the new ones
+        for (u64 k = same_points; k < num_points; k++) seed_coherence_touch(coherence, points[2*k], points[2*k + 1], max_r);
+    }
+
+    coherence->num_dirty = 0;
+    for (u64 j = 0; j < height; j++) coherence->row_dirty[j] = false;
+    for (u64 t = 0; t < num_tiles; t++) {
+        if (!coherence->tile_dirty[t]) continue;
+        coherence->num_dirty += 1;
+
+        u64 y0 = (t / tiles_x) * SEED_COHERENCE_TILE;
+        u64 y1 = y0 + SEED_COHERENCE_TILE < height ? y0 + SEED_COHERENCE_TILE : height;
+        for (u64 j = y0; j < y1; j++) coherence->row_dirty[j] = true;
+    }
+
+
+    if (coherence->point_capacity < num_points) {
+        coherence->point_capacity = num_points;
+        free(coherence->points);
+        coherence->points = malloc(2 * coherence->point_capacity * sizeof(float));
+        assert(coherence->points != NULL && "Buy More RAM lol");
+    }
+    memcpy(coherence->points, points, 2 * num_points * sizeof(float));
+
+    coherence->current ^= 1;
+    coherence->width  = width;
+    coherence->height = height;
+    coherence->num_points = num_points;
+}
+
+// the labels were made some other way this frame, dont trust the old ones next frame.
+static void seed_coherence_forget(Seed_Coherence *coherence) {
+    coherence->width  = 0;
+    coherence->height = 0;
+}
+
+
+// starts over with no points in 'near'
+static void seed_coherence_clear(Seed_Coherence_Scratch *scratch, u64 num_points) {
+    if (scratch->stamps_capacity < num_points) {
+        free(scratch->stamps);
+        scratch->stamps_capacity = num_points;
+        scratch->stamps = calloc(scratch->stamps_capacity, sizeof(u32));
+        assert(scratch->stamps != NULL && "Buy More RAM lol");
+        scratch->stamp = 0;
+    }
+
+    scratch->stamp += 1;
+    // wrapped around, the old stamps could look new.
+    if (scratch->stamp == 0) {
+        for (u64 k = 0; k < scratch->stamps_capacity; k++) scratch->stamps[k] = 0;
+        scratch->stamp = 1;
+    }
+
+    scratch->near_count = 0;
+}
+
+static void seed_coherence_add(Seed_Coherence_Scratch *scratch, u32 id) {
+    if (scratch->stamps[id] == scratch->stamp) return;
+    scratch->stamps[id] = scratch->stamp;
+
+    if (scratch->near_count >= scratch->near_capacity) {
+        scratch->near_capacity = scratch->near_capacity ? 2*scratch->near_capacity : 64;
+        scratch->near = realloc(scratch->near, scratch->near_capacity * sizeof(u32));
+        assert(scratch->near != NULL && "Buy More RAM lol");
+    }
+    scratch->near[scratch->near_count++] = id;
+}
+
+// sorts 'near' by index, and puts those points in the soa.
+static void seed_coherence_load(Seed_Coherence_Scratch *scratch, const float *points) {
+    u32 *near = scratch->near;
+    u64 count = scratch->near_count;
+
+    // there are only ever a few dozen.
+    for (u64 i = 1; i < count; i++) {
+        u32 id = near[i];
+        u64 j = i;
+        for (; j > 0 && near[j-1] > id; j--) near[j] = near[j-1];
+        near[j] = id;
+    }
+
+    seed_soa_reserve(&scratch->soa, count);
+    if (scratch->ids_capacity < count) {
+        scratch->ids_capacity = scratch->soa.capacity;
+        free(scratch->ids);
+        scratch->ids = malloc(scratch->ids_capacity * sizeof(u32));
+        assert(scratch->ids != NULL && "Buy More RAM lol");
+    }
+
+    for (u64 k = 0; k < count; k++) {
+        scratch->soa.xs[k] = points[2*near[k]];
+        scratch->soa.ys[k] = points[2*near[k] + 1];
+        scratch->ids[k] = near[k];
+    }
+    scratch->soa.count = count;
+}
+
+// step 2, labels the tile with the closest point in the soa,
+// returns how far the furthest pixel is from its point.
+static float seed_coherence_closest(Seed_Coherence_Scratch *scratch, u32 *labels, u64 width, u64 x0, u64 y0, u64 x1, u64 y1) {
+    u64 tile_width = x1 - x0;
+    for (u64 j = 0; j < y1 - y0; j++) scratch->row_r[j] = 0;
+
+    // most tiles are one or two cells, this only does the pixels near the edges.
+    seed_soa_rect(&scratch->soa, scratch->tile, tile_width, x0, y0, x1, y1, scratch->row_r);
+
+    float furthest_d = 0;
+    for (u64 j = y0; j < y1; j++) {
+        const u32 *row = &scratch->tile[(j - y0) * tile_width];
+        for (u64 i = 0; i < tile_width; i++) labels[j * width + x0 + i] = scratch->ids[row[i]];
+
+        if (furthest_d < scratch->row_r[j - y0]) furthest_d = scratch->row_r[j - y0];
+    }
+
+    return sqrtf(furthest_d);
+}
+
+// step 3, adds every point in the grid that could be closer to a pixel
+// of the tile than its point is now. returns false if there were any.
+static bool seed_coherence_gather(Seed_Coherence_Scratch *scratch, const Seed_Grid *grid, float r, u64 x0, u64 y0, u64 x1, u64 y1) {
+    // the pixels are at x0 .. x1-1, and it all rounds a bit.
+    float left = x0, right  = x1 - 1;
+    float top  = y0, bottom = y1 - 1;
+    r += SEED_GRID_EPSILON;
+
+    // points past the edge of the grid are in the edge cells, the clamping gets those too.
+    s64 cx0 = seed_grid_cell_x(grid, left - r), cx1 = seed_grid_cell_x(grid, right  + r);
+    s64 cy0 = seed_grid_cell_y(grid, top  - r), cy1 = seed_grid_cell_y(grid, bottom + r);
+
+    u64 old_count = scratch->near_count;
+
+    for (s64 cy = cy0; cy <= cy1; cy++) {
+        for (s64 cx = cx0; cx <= cx1; cx++) {
+            s64 c = cy*grid->cols + cx;
+            for (u32 k = grid->cell_start[c]; k < grid->cell_start[c+1]; k++) {
+                u32 id = grid->ids[k];
+                if (scratch->stamps[id] == scratch->stamp) continue;
+
+                float px = grid->xs[k], py = grid->ys[k];
+                float dx = px < left ? left - px : px > right  ? px - right  : 0;
+                float dy = py < top  ? top  - py : py > bottom ? py - bottom : 0;
+                if (dx*dx + dy*dy > r*r) continue;
+
+                // close to the tile, but is it close to a row thats that far from its points?
+                for (u64 j = y0; j < y1; j++) {
+                    float row_r = sqrtf(scratch->row_r[j - y0]) + SEED_GRID_EPSILON;
+                    float ry = py - j;
+                    if (dx*dx + ry*ry <= row_r*row_r) {
+                        seed_coherence_add(scratch, id);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return scratch->near_count == old_count;
+}
+
+
+// fills the labels of the tile [x0, x1) x [y0, y1), 'grid' has to be built from 'points'.
+// different tiles can be done on different threads, with different scratches.
+// returns how many times it did step 2, 0 if the tile didnt change.
+static u64 seed_coherence_rect(Seed_Coherence *coherence, Seed_Coherence_Scratch *scratch,
+                               const Seed_Grid *grid, const float *points, u32 *labels,
+                               u64 x0, u64 y0, u64 x1, u64 y1) {
+    assert(x0 % SEED_COHERENCE_TILE == 0 && y0 % SEED_COHERENCE_TILE == 0);
+    if (x0 >= x1 || y0 >= y1) return 0;
+
+    u64 width  = coherence->width;
+    u64 height = coherence->height;
+    const u32 *old_labels = coherence->labels[coherence->current ^ 1];
+    u32       *new_labels = coherence->labels[coherence->current];
+
+    u64 tile = (y0 / SEED_COHERENCE_TILE) * coherence->tiles_x + x0 / SEED_COHERENCE_TILE;
+    if (!coherence->tile_dirty[tile]) {
+        for (u64 j = y0; j < y1; j++) {
+            memcpy(&new_labels[j * width + x0], &old_labels[j * width + x0], (x1 - x0) * sizeof(u32));
+            memcpy(&labels    [j * width + x0], &old_labels[j * width + x0], (x1 - x0) * sizeof(u32));
+        }
+        return 0;
+    }
+    // a clean tile doesnt look at the grid, so it may not have been built this frame.
+    assert(grid->num_points > 0);
+
+    if (scratch->tile_capacity < (x1 - x0) * (y1 - y0)) {
+        scratch->tile_capacity = (x1 - x0) * (y1 - y0);
+        free(scratch->tile);
+        scratch->tile = malloc(scratch->tile_capacity * sizeof(u32));
+        assert(scratch->tile != NULL && "Buy More RAM lol");
+    }
+    if (scratch->row_r_capacity < y1 - y0) {
+        scratch->row_r_capacity = y1 - y0;
+        free(scratch->row_r);
+        scratch->row_r = malloc(scratch->row_r_capacity * sizeof(float));
+        assert(scratch->row_r != NULL && "Buy More RAM lol");
+    }
+
+    // 1. last frame's points, in and around the tile
+    seed_coherence_clear(scratch, coherence->num_points);
+    if (coherence->has_history) {
+        u64 bx0 = x0 > SEED_COHERENCE_BORDER ? x0 - SEED_COHERENCE_BORDER : 0;
+        u64 by0 = y0 > SEED_COHERENCE_BORDER ? y0 - SEED_COHERENCE_BORDER : 0;
+        u64 bx1 = x1 + SEED_COHERENCE_BORDER < width  ? x1 + SEED_COHERENCE_BORDER : width;
+        u64 by1 = y1 + SEED_COHERENCE_BORDER < height ? y1 + SEED_COHERENCE_BORDER : height;
+
+        for (u64 j = by0; j < by1; j++) {
+            u32 last = (u32) -1;
+            for (u64 i = bx0; i < bx1; i++) {
+                u32 id = old_labels[j * width + i];
+                // mostly long runs of the same one
+                if (id == last) continue;
+                last = id;
+                // skip the ones that are gone now
+                if (id < coherence->num_points) seed_coherence_add(scratch, id);
+            }
+        }
+    }
+    if (scratch->near_count == 0) {
+        seed_coherence_add(scratch, seed_grid_nearest(grid, (x0 + x1) / 2, (y0 + y1) / 2));
+    }
+
+    // 2.
+    seed_coherence_load(scratch, points);
+    float r = seed_coherence_closest(scratch, new_labels, width, x0, y0, x1, y1);
+
+    // 3-4.
+    u64 passes = 1;
+    if (!seed_coherence_gather(scratch, grid, r, x0, y0, x1, y1)) {
+        seed_coherence_load(scratch, points);
+        r = seed_coherence_closest(scratch, new_labels, width, x0, y0, x1, y1);
+        passes = 2;
+    }
+    coherence->tile_r[tile] = r;
+
+    for (u64 j = y0; j < y1; j++) {
+        for (u64 i = x0; i < x1; i++) labels[j * width + i] = new_labels[j * width + i];
+    }
+
+    return passes;
+}
+
+
+static void seed_coherence_scratch_free(Seed_Coherence_Scratch *scratch) {
+    seed_soa_free(&scratch->soa);
+    free(scratch->ids);
+    free(scratch->near);
+    free(scratch->stamps);
+    free(scratch->tile);
+    free(scratch->row_r);
+    *scratch = (Seed_Coherence_Scratch){0};
+}
+
+static void seed_coherence_free(Seed_Coherence *coherence) {
+    free(coherence->labels[0]);
+    free(coherence->labels[1]);
+    free(coherence->points);
+    free(coherence->tile_r);
+    free(coherence->tile_dirty);
+    free(coherence->row_dirty);
+    *coherence = (Seed_Coherence){0};
+}
+
+#endif // SEED_COHERENCE_H_
@@ -0,0 +1,433 @@
+//
+// seed_file.h - load a lot of points from a file, fast
+//
+// two kinds of file:
+//
+// - packed binary, (anything thats not .csv or .txt) x, y pairs of little
+//   endian f32, one after another, nothing else.
+// - text, one point a line, x and y are the first two numbers on it,
+//   (split by commas, spaces, tabs or semicolons) lines that dont start
+//   with a number, like a header, are skipped.
+//
+// the file is mmapped and cut into pieces, that the pool threads work on.
+// a text file is gone through twice, first every piece counts its lines, so
+// it knows where its points go, then they all parse straight into the callers
+// array. then the points are scaled to fit the screen, keeping their shape,
+// (and y flipped, so up in the file is up on the screen) and get a color.
+//
+// #define SEED_FILE_IMPLEMENTATION in exactly one file. (main.c, render.c)
+// needs thread_pool.h, linux only. (mmap)
+//
+
+#ifndef SEED_FILE_H_
+#define SEED_FILE_H_
+
+#include <stdbool.h>
+
+#include "ints.h"
+
+typedef struct Seed_File {
+    const u8 *data;
+    u64 size;
+    bool text;
+
+    // how many points there are
+    u64 count;
+
+    // for text, where every piece's points go
+    u64 *piece_starts;
+    u64 num_pieces;
+} Seed_File;
+
+
+// maps the file and counts the points, false if it cant. (prints why)
+bool seed_file_open(Seed_File *file, const char *path);
+// 'points' is count x, y pairs, (a Vector2 array) 'colors' count rgba's (a Color array)
+// the points end up in [0, width] x [0, height].
+void seed_file_read(Seed_File *file, float *points, u8 *colors, float width, float height);
+void seed_file_close(Seed_File *file);
+
+#endif // SEED_FILE_H_
+
+
+#ifdef SEED_FILE_IMPLEMENTATION
+
+#ifndef SEED_FILE_IMPLEMENTATION_
+#define SEED_FILE_IMPLEMENTATION_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "thread_pool.h"
+
+// how many bytes of text every piece gets
+#define SEED_FILE_PIECE (1 << 20)
+// how many points every piece gets, for everything else
+#define SEED_FILE_CHUNK (1 << 16)
+// how many hues the colors are picked from
+#define SEED_FILE_PALETTE_BITS 10
+
+// the bounds of what one thread saw, on its own cache line
+typedef struct Seed_File_Bounds {
+    float min_x, min_y;
+    float max_x, max_y;
+    char padding[64 - 4*sizeof(float)];
+} Seed_File_Bounds;
+
+typedef struct Seed_File_Job {
+    Seed_File *file;
+    float *points;
+    u8 *colors;
+
+    Seed_File_Bounds *bounds;
+    // rgba, see seed_file_color()
+    u32 palette[1 << SEED_FILE_PALETTE_BITS];
+
+    // the points go from 'min' to 'offset' + ('point' - 'min') * 'scale'
+    float min_x, min_y;
+    float scale;
+    float offset_x, offset_y;
+    float width, height;
+} Seed_File_Job;
+
+
+static bool seed_file_is_number_start(u8 c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+static bool seed_file_is_space(u8 c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// where the line with the byte at 'at' in it starts
+static const u8 *seed_file_piece_start(Seed_File *file, u64 piece) {
+    const u8 *end = file->data + file->size;
+    if (piece * SEED_FILE_PIECE >= file->size) return end;
+
+    const u8 *at = file->data + piece * SEED_FILE_PIECE;
+    if (piece == 0) return at;
+
+    // the line thats cut in half belongs to the piece before
+    if (at[-1] == '\n') return at;
+    const u8 *newline = memchr(at, '\n', end - at);
+    return newline ? newline + 1 : end;
+}
+
+// if the line at 'at' is a point, (it starts with a number)
+static bool seed_file_is_point(const u8 *at, const u8 *end) {
+    while (at < end && seed_file_is_space(*at)) at++;
+    return at < end && seed_file_is_number_start(*at);
+}
+
+// 10^0 .. 10^22 are exact as doubles
+static const double seed_file_powers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// like strtof(), but it stops at 'end', (the file doesnt end with a 0) and
+// its a lot quicker. NAN if theres no number there.
+static const u8 *seed_file_number(const u8 *at, const u8 *end, float *out) {
+    while (at < end && (seed_file_is_space(*at) || *at == ',' || *at == ';')) at++;
+
+    bool negative = false;
+    if (at < end && (*at == '-' || *at == '+')) negative = *at++ == '-';
+
+    u64 mantissa = 0;
+    int exponent = 0;
+    int digits   = 0;
+    // past 19 digits they dont fit, and dont matter to a float.
+    // (zeros in front dont count, the mantissa stays 0 for them)
+    const u64 full = 1000000000000000000ull;
+    for (; at < end && (u8) (*at - '0') < 10; at++, digits++) {
+        if (mantissa < full) mantissa = mantissa*10 + (*at - '0');
+        else exponent += 1;
+    }
+    if (at < end && *at == '.') {
+        for (at++; at < end && (u8) (*at - '0') < 10; at++, digits++) {
+            if (mantissa < full) {
+                mantissa = mantissa*10 + (*at - '0');
+                exponent -= 1;
+            }
+        }
+    }
+    if (digits == 0) {
+        *out = NAN;
+        return at;
+    }
+
+    if (at < end && (*at == 'e' || *at == 'E')) {
+        const u8 *e = at + 1;
+        bool e_negative = false;
+        if (e < end && (*e == '-' || *e == '+')) e_negative = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9') {
+            int e_value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++) {
+                if (e_value < 10000) e_value = e_value*10 + (*e - '0');
+            }
+            exponent += e_negative ? -e_value : e_value;
+            at = e;
+        }
+    }
+
+    double value = mantissa;
+    if      (exponent >= 0 && exponent <= 22) value *= seed_file_powers[exponent];
+    else if (exponent <  0 && exponent >= -22) value /= seed_file_powers[-exponent];
+    else    value *= pow(10, exponent);
+
+    *out = negative ? -value : value;
+    return at;
+}
+
+
+static void seed_file_count_piece(void *data, u64 start, u64 end, u64 thread) {
+    (void) thread;
+    Seed_File *file = data;
+    const u8 *file_end = file->data + file->size;
+
+    for (u64 piece = start; piece < end; piece++) {
+        const u8 *at   = seed_file_piece_start(file, piece);
+        const u8 *stop = seed_file_piece_start(file, piece + 1);
+
+        u64 count = 0;
+        while (at < stop) {
+            const u8 *newline = memchr(at, '\n', file_end - at);
+            const u8 *line_end = newline ? newline : file_end;
+            count += seed_file_is_point(at, line_end);
+            at = line_end + 1;
+        }
+        file->piece_starts[piece] = count;
+    }
+}
+
+static void seed_file_bounds_add(Seed_File_Bounds *bounds, float x, float y) {
+    // whatever didnt parse, (or was too big for a float) doesnt get in
+    if (isfinite(x)) {
+        if (x < bounds->min_x) bounds->min_x = x;
+        if (x > bounds->max_x) bounds->max_x = x;
+    }
+    if (isfinite(y)) {
+        if (y < bounds->min_y) bounds->min_y = y;
+        if (y > bounds->max_y) bounds->max_y = y;
+    }
+}
+
+static void seed_file_parse_piece(void *data, u64 start, u64 end, u64 thread) {
+    Seed_File_Job *job = data;
+    Seed_File *file = job->file;
+    Seed_File_Bounds *bounds = &job->bounds[thread];
+    const u8 *file_end = file->data + file->size;
+
+    for (u64 piece = start; piece < end; piece++) {
+        const u8 *at   = seed_file_piece_start(file, piece);
+        const u8 *stop = seed_file_piece_start(file, piece + 1);
+
+        float *out = job->points + 2*file->piece_starts[piece];
+        while (at < stop) {
+            // the numbers stop at the newline on their own, (its not a separator)
+            // so only whats after them has to be looked through for it.
+            if (seed_file_is_point(at, file_end)) {
+                float x, y;
+                at = seed_file_number(at, file_end, &x);
+                at = seed_file_number(at, file_end, &y);
+
+                *out++ = x;
+                *out++ = y;
+                seed_file_bounds_add(bounds, x, y);
+            }
+
+            const u8 *newline = memchr(at, '\n', file_end - at);
+            at = newline ? newline + 1 : file_end;
+        }
+    }
+}
+
+static void seed_file_copy_chunk(void *data, u64 start, u64 end, u64 thread) {
+    Seed_File_Job *job = data;
+    Seed_File_Bounds *bounds = &job->bounds[thread];
+
+    memcpy(job->points + 2*start, job->file->data + 2*start*sizeof(float), 2*(end - start)*sizeof(float));
+    for (u64 i = start; i < end; i++) seed_file_bounds_add(bounds, job->points[2*i + 0], job->points[2*i + 1]);
+}
+
+// raylib's ColorFromHSV(), (like add_new_point(), 0.7 saturation and value)
+static void seed_file_hue(float hue, u8 *rgba) {
+    float offsets[3] = {5.0f, 3.0f, 1.0f};
+    for (int c = 0; c < 3; c++) {
+        float k = fmodf(offsets[c] + hue/60.0f, 6);
+        float t = 4.0f - k;
+        k = (t < k) ? t : k;
+        k = (k < 1) ? k : 1;
+        k = (k > 0) ? k : 0;
+        rgba[c] = (0.7f - 0.7f*0.7f*k) * 255.0f;
+    }
+    rgba[3] = 255;
+}
+
+// a random looking hue for every point, the same one every time. out of the
+// table, the fmodf()'s in seed_file_hue() take longer than the rest put together.
+static u32 seed_file_color(const u32 *palette, u64 i) {
+    // https://prng.di.unimi.it/splitmix64.c
+    u64 z = i * 0x9e3779b97f4a7c15 + 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z = z ^ (z >> 31);
+    return palette[z >> (64 - SEED_FILE_PALETTE_BITS)];
+}
+
+static void seed_file_fit_chunk(void *data, u64 start, u64 end, u64 thread) {
+    (void) thread;
+    Seed_File_Job *job = data;
+
+    for (u64 i = start; i < end; i++) {
+        float x = job->points[2*i + 0];
+        float y = job->points[2*i + 1];
+        // whatever didnt parse goes in the corner
+        if (!isfinite(x)) x = job->min_x;
+        if (!isfinite(y)) y = job->min_y;
+
+        x = job->offset_x + (x - job->min_x) * job->scale;
+        y = job->height - (job->offset_y + (y - job->min_y) * job->scale);
+        // (the rounding can put the ones on the edge a hair outside)
+        job->points[2*i + 0] = fminf(fmaxf(x, 0), job->width);
+        job->points[2*i + 1] = fminf(fmaxf(y, 0), job->height);
+
+        u32 color = seed_file_color(job->palette, i);
+        memcpy(&job->colors[4*i], &color, sizeof(color));
+    }
+}
+
+
+bool seed_file_open(Seed_File *file, const char *path) {
+    *file = (Seed_File){0};
+
+    const char *extension = strrchr(path, '.');
+    file->text = extension && (strcmp(extension, ".csv") == 0 || strcmp(extension, ".txt") == 0);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(stderr, "ERROR: could not stat '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    file->size = info.st_size;
+
+    if (!file->text && file->size % (2*sizeof(float)) != 0) {
+        fprintf(stderr, "ERROR: '%s' is not x, y pairs of f32, (its %zu bytes) use .csv for text\n", path, file->size);
+        close(fd);
+        return false;
+    }
+
+    if (file->size > 0) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "ERROR: could not map '%s': %s\n", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = data;
+    }
+    // the mapping keeps the file
+    close(fd);
+
+    if (!file->text) {
+        file->count = file->size / (2*sizeof(float));
+        return true;
+    }
+
+    file->num_pieces = (file->size + SEED_FILE_PIECE - 1) / SEED_FILE_PIECE;
+    file->piece_starts = malloc((file->num_pieces + 1) * sizeof(u64));
+    assert(file->piece_starts != NULL && "Buy More RAM lol");
+
+    pool_for(file->num_pieces, 1, seed_file_count_piece, file);
+
+    // the counts, into where every piece starts
+    u64 count = 0;
+    for (u64 i = 0; i < file->num_pieces; i++) {
+        u64 piece_count = file->piece_starts[i];
+        file->piece_starts[i] = count;
+        count += piece_count;
+    }
+    file->piece_starts[file->num_pieces] = count;
+    file->count = count;
+
+    return true;
+}
+
+void seed_file_read(Seed_File *file, float *points, u8 *colors, float width, float height) {
+    if (file->count == 0) return;
+
+    u64 num_threads = pool_num_threads();
+    Seed_File_Bounds *bounds = malloc(num_threads * sizeof(Seed_File_Bounds));
+    assert(bounds != NULL && "Buy More RAM lol");
+    for (u64 i = 0; i < num_threads; i++) {
+        bounds[i] = (Seed_File_Bounds){INFINITY, INFINITY, -INFINITY, -INFINITY, {0}};
+    }
+
+    Seed_File_Job job = {
+        .file   = file,
+        .points = points,
+        .colors = colors,
+        .bounds = bounds,
+    };
+
+    if (file->text) pool_for(file->num_pieces, 1, seed_file_parse_piece, &job);
+    else            pool_for(file->count, SEED_FILE_CHUNK, seed_file_copy_chunk, &job);
+
+    Seed_File_Bounds all = bounds[0];
+    for (u64 i = 1; i < num_threads; i++) {
+        seed_file_bounds_add(&all, bounds[i].min_x, bounds[i].min_y);
+        seed_file_bounds_add(&all, bounds[i].max_x, bounds[i].max_y);
+    }
+    free(bounds);
+    // nothing was a number
+    if (all.min_x > all.max_x) all.min_x = all.max_x = 0;
+    if (all.min_y > all.max_y) all.min_y = all.max_y = 0;
+
+    // as big as fits, in the middle
+    float size_x = all.max_x - all.min_x;
+    float size_y = all.max_y - all.min_y;
+    float scale_x = size_x > 0 ? width  / size_x : INFINITY;
+    float scale_y = size_y > 0 ? height / size_y : INFINITY;
+    job.scale = scale_x < scale_y ? scale_x : scale_y;
+    if (isinf(job.scale)) job.scale = 1;
+
+    job.min_x    = all.min_x;
+    job.min_y    = all.min_y;
+    job.offset_x = (width  - size_x * job.scale) / 2;
+    job.offset_y = (height - size_y * job.scale) / 2;
+    for (u64 i = 0; i < (1 << SEED_FILE_PALETTE_BITS); i++) {
+        seed_file_hue(i * 360.0f / (1 << SEED_FILE_PALETTE_BITS), (u8 *) &job.palette[i]);
+    }
+
+    job.width    = width;
+    job.height   = height;
+
+    pool_for(file->count, SEED_FILE_CHUNK, seed_file_fit_chunk, &job);
+}
+
+void seed_file_close(Seed_File *file) {
+    if (file->data) munmap((void *) file->data, file->size);
+    free(file->piece_starts);
+    *file = (Seed_File){0};
+}
+
+#endif // SEED_FILE_IMPLEMENTATION_
+
+#endif // SEED_FILE_IMPLEMENTATION
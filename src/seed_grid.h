@@ -0,0 +1,205 @@
+//
+// seed_grid.h - uniform bucket grid over the points, for nearest point lookups
+//
+// the points are counting sorted into square cells once per frame,
+// then a lookup searches rings of cells around the pixel, and stops
+// as soon as no unsearched cell can hold anything closer.
+//
+// gives the exact same answer as checking every point, ties included,
+// (the lowest index wins) so its a drop in for the brute force loops.
+//
+// everything in here is static, every backend gets its own copy.
+// (the bench links them all into the one binary)
+//
+
+#ifndef SEED_GRID_H_
+#define SEED_GRID_H_
+
+#include <stddef.h>
+
+#include "ints.h"
+
+// how many points a cell should have on average.
+#define SEED_GRID_POINTS_PER_CELL 2.0f
+
+typedef struct Seed_Grid {
+    float cell_size;
+    float inv_cell_size;
+    s64 cols, rows;
+
+    // cell 'c' holds the points in [cell_start[c], cell_start[c+1])
+    u32 *cell_start;
+    u64 cell_capacity;
+
+    // the points sorted by cell
+    float *xs;
+    float *ys;
+    u32   *ids;
+    u64 point_capacity;
+
+    u64 num_points;
+} Seed_Grid;
+
+
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+// cells are assigned with float math, so a point can be
+// a hair outside its cell. dont trust the bounds that much.
+#define SEED_GRID_EPSILON 0.01f
+
+
+static s64 seed_grid_clamp(s64 x, s64 low, s64 high) {
+    if (x < low)  return low;
+    if (x > high) return high;
+    return x;
+}
+
+static s64 seed_grid_cell_x(const Seed_Grid *grid, float x) {
+    return seed_grid_clamp((s64) floorf(x * grid->inv_cell_size), 0, grid->cols - 1);
+}
+static s64 seed_grid_cell_y(const Seed_Grid *grid, float y) {
+    return seed_grid_clamp((s64) floorf(y * grid->inv_cell_size), 0, grid->rows - 1);
+}
+
+
+// 'points' is x, y pairs, points outside of width*height are fine.
+static void seed_grid_build(Seed_Grid *grid, const float *points, u64 num_points, u64 width, u64 height) {
+    if (width  == 0) width  = 1;
+    if (height == 0) height = 1;
+
+    // size the cells for the average density
+    float area_per_point = (float) width * (float) height / (num_points ? num_points : 1);
+    float cell_size = sqrtf(area_per_point * SEED_GRID_POINTS_PER_CELL);
+    if (cell_size < 1) cell_size = 1;
+
+    grid->cell_size     = cell_size;
+    grid->inv_cell_size = 1.0f / cell_size;
+    grid->cols = (s64) ceilf(width  / cell_size);
+    grid->rows = (s64) ceilf(height / cell_size);
+    if (grid->cols < 1) grid->cols = 1;
+    if (grid->rows < 1) grid->rows = 1;
+    grid->num_points = num_points;
+
+    u64 num_cells = grid->cols * grid->rows;
+    if (grid->cell_capacity < num_cells + 1) {
+        grid->cell_capacity = num_cells + 1;
+        free(grid->cell_start);
+        grid->cell_start = malloc(grid->cell_capacity * sizeof(u32));
+        assert(grid->cell_start != NULL && "Buy More RAM lol");
+    }
+    if (grid->point_capacity < num_points) {
+        grid->point_capacity = num_points;
+        free(grid->xs);
+        free(grid->ys);
+        free(grid->ids);
+        grid->xs  = malloc(grid->point_capacity * sizeof(float));
+        grid->ys  = malloc(grid->point_capacity * sizeof(float));
+        grid->ids = malloc(grid->point_capacity * sizeof(u32));
+        assert(grid->xs && grid->ys && grid->ids && "Buy More RAM lol");
+    }
+
+    // counting sort, count every cell...
+    u32 *cell_start = grid->cell_start;
+    for (u64 c = 0; c < num_cells + 1; c++) cell_start[c] = 0;
+
+    for (u64 k = 0; k < num_points; k++) {
+        s64 cx = seed_grid_cell_x(grid, points[2*k]);
+        s64 cy = seed_grid_cell_y(grid, points[2*k + 1]);
+        cell_start[cy*grid->cols + cx + 1] += 1;
+    }
+
+    // ...prefix sum...
+    for (u64 c = 0; c < num_cells; c++) cell_start[c+1] += cell_start[c];
+
+    // ...and put them in their place. this uses cell_start[c] as a cursor,
+    // so afterwards every cell_start has moved up one cell, shift it back.
+    for (u64 k = 0; k < num_points; k++) {
+        float x = points[2*k];
+        float y = points[2*k + 1];
+        s64 c = seed_grid_cell_y(grid, y)*grid->cols + seed_grid_cell_x(grid, x);
+
+        u32 slot = cell_start[c]++;
+        grid->xs [slot] = x;
+        grid->ys [slot] = y;
+        grid->ids[slot] = k;
+    }
+    for (u64 c = num_cells; c > 0; c--) cell_start[c] = cell_start[c-1];
+    cell_start[0] = 0;
+}
+
+
+// checks one cell, keeps the closest (lowest index on ties)
+static inline void seed_grid_check_cell(const Seed_Grid *grid, s64 cx, s64 cy, float x, float y, float *best_d, u32 *best_id) {
+    s64 c = cy*grid->cols + cx;
+    for (u32 k = grid->cell_start[c]; k < grid->cell_start[c+1]; k++) {
+        // same order of operations as seed_soa_nearest(), so its bit for bit the same.
+        float d = (grid->xs[k]-x)*(grid->xs[k]-x) + (grid->ys[k]-y)*(grid->ys[k]-y);
+        u32 id = grid->ids[k];
+        if (d < *best_d || (d == *best_d && id < *best_id)) {
+            *best_d  = d;
+            *best_id = id;
+        }
+    }
+}
+
+// index of the closest point to (x, y), grid must not be empty.
+static inline u32 seed_grid_nearest(const Seed_Grid *grid, float x, float y) {
+    assert(grid->num_points > 0);
+
+    s64 cx = seed_grid_cell_x(grid, x);
+    s64 cy = seed_grid_cell_y(grid, y);
+
+    float best_d  = INFINITY;
+    u32   best_id = (u32) -1;
+
+    for (s64 r = 0; ; r++) {
+        s64 x0 = cx - r, x1 = cx + r;
+        s64 y0 = cy - r, y1 = cy + r;
+
+        if (r == 0) {
+            seed_grid_check_cell(grid, cx, cy, x, y, &best_d, &best_id);
+        } else {
+            // the top and bottom rows of the ring
+            for (s64 i = seed_grid_clamp(x0, 0, grid->cols-1); i <= seed_grid_clamp(x1, 0, grid->cols-1); i++) {
+                if (y0 >= 0)         seed_grid_check_cell(grid, i, y0, x, y, &best_d, &best_id);
+                if (y1 < grid->rows) seed_grid_check_cell(grid, i, y1, x, y, &best_d, &best_id);
+            }
+            // the left and right sides, without the corners
+            for (s64 j = seed_grid_clamp(y0+1, 0, grid->rows-1); j <= seed_grid_clamp(y1-1, 0, grid->rows-1); j++) {
+                if (x0 >= 0)         seed_grid_check_cell(grid, x0, j, x, y, &best_d, &best_id);
+                if (x1 < grid->cols) seed_grid_check_cell(grid, x1, j, x, y, &best_d, &best_id);
+            }
+        }
+
+        // searched everything
+        if (x0 <= 0 && y0 <= 0 && x1 >= grid->cols-1 && y1 >= grid->rows-1) break;
+
+        // anything not searched yet is outside the searched square,
+        // (points past the edge of the grid live in the edge cells, so
+        // a side that reached the edge has nothing left behind it)
+        float bound = INFINITY;
+        if (x0 > 0)              bound = fminf(bound, x - x0*grid->cell_size);
+        if (y0 > 0)              bound = fminf(bound, y - y0*grid->cell_size);
+        if (x1 < grid->cols - 1) bound = fminf(bound, (x1+1)*grid->cell_size - x);
+        if (y1 < grid->rows - 1) bound = fminf(bound, (y1+1)*grid->cell_size - y);
+        bound -= SEED_GRID_EPSILON;
+
+        // strictly closer, so an unsearched point with a lower index cant tie.
+        if (bound > 0 && best_d < bound*bound) break;
+    }
+
+    return best_id;
+}
+
+
+static void seed_grid_free(Seed_Grid *grid) {
+    free(grid->cell_start);
+    free(grid->xs);
+    free(grid->ys);
+    free(grid->ids);
+    *grid = (Seed_Grid){0};
+}
+
+#endif // SEED_GRID_H_
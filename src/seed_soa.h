@@ -0,0 +1,462 @@
+//
+// seed_soa.h - the points as separate x and y arrays, and a SIMD brute force over them
+//
+// the brute force loops read the points as x, y pairs, and check one pixel
+// at a time. this copies them into aligned x[] and y[] arrays once per frame,
+// and checks 4, 8 or 16 pixels of a row at once, (SSE2, AVX2 or AVX-512)
+// whichever the CPU has, picked when the arrays are built.
+//
+// seed_soa_rect() does a whole rectangle. the cells are convex, so if all
+// four corners have the same closest point, so does everything between them,
+// and it just fills it. otherwise it splits it in four and tries again,
+// down to SEED_SOA_RECT_MIN, where it does every pixel.
+//
+// seed_soa_spans() goes the other way, along a row every cell is one run of
+// pixels, and where the runs start can be worked out from the points alone.
+// only the few pixels at the ends of the runs are checked one by one.
+//
+// gives the exact same answer as checking every point, ties included,
+// (the lowest index wins) so its a drop in for the brute force loops.
+//
+// everything in here is static, every backend gets its own copy.
+// (the bench links them all into the one binary)
+//
+
+#ifndef SEED_SOA_H_
+#define SEED_SOA_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <assert.h>
+
+#include "ints.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEED_SOA_X86
+#include <immintrin.h>
+#endif // __x86_64__ || __i386__
+
+// enough for an AVX-512 register, and a cache line.
+#define SEED_SOA_ALIGN 64
+
+typedef struct Seed_Soa Seed_Soa;
+
+// labels[i] gets the closest point to (x + i, y), for 'count' pixels.
+typedef void Seed_Soa_Row_Fn(const Seed_Soa *soa, u32 *labels, u64 count, float x, float y);
+
+struct Seed_Soa {
+    float *xs;
+    float *ys;
+    u64 count;
+    u64 capacity;
+
+    // the points ordered by x, for seed_soa_spans(). (only after seed_soa_sort())
+    u32 *by_x;
+    u64 by_x_capacity;
+    bool sorted;
+
+    // the fastest one this CPU can run
+    Seed_Soa_Row_Fn *nearest_row;
+    const char *nearest_row_name;
+};
+
+
+// checks one pixel against every point, same as brute_force_nearest() in the backends.
+static inline u32 seed_soa_nearest(const Seed_Soa *soa, float x, float y) {
+    u32   best_id = 0;
+    float best_d  = INFINITY;
+    for (u64 k = 0; k < soa->count; k++) {
+        // same order of operations as dist_sqr(), so its bit for bit the same.
+        float d = (soa->xs[k]-x)*(soa->xs[k]-x) + (soa->ys[k]-y)*(soa->ys[k]-y);
+        if (d < best_d) {
+            best_d  = d;
+            best_id = k;
+        }
+    }
+    return best_id;
+}
+
+static void seed_soa_row_scalar(const Seed_Soa *soa, u32 *labels, u64 count, float x, float y) {
+    for (u64 i = 0; i < count; i++) labels[i] = seed_soa_nearest(soa, x + i, y);
+}
+
+
+// all of these keep the closest distance and its index for every pixel,
+// and only take a point if its strictly closer, so going up from point 0
+// the lowest index wins the ties. (no FMA, that would round differently)
+#ifdef SEED_SOA_X86
+
+__attribute__((target("sse2")))
+static void seed_soa_row_sse2(const Seed_Soa *soa, u32 *labels, u64 count, float x, float y) {
+    u64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(x + i), _mm_setr_ps(0, 1, 2, 3));
+        __m128 py = _mm_set1_ps(y);
+
+        __m128  best_d  = _mm_set1_ps(INFINITY);
+        __m128i best_id = _mm_setzero_si128();
+
+        for (u64 k = 0; k < soa->count; k++) {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(soa->xs[k]), px);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(soa->ys[k]), py);
+            __m128 d  = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+            // no blend in SSE2, do it with and / andnot / or
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best_d));
+            __m128i id     = _mm_set1_epi32(k);
+            best_d  = _mm_min_ps(d, best_d);
+            best_id = _mm_or_si128(_mm_and_si128(closer, id), _mm_andnot_si128(closer, best_id));
+        }
+
+        _mm_storeu_si128((__m128i *) &labels[i], best_id);
+    }
+
+    seed_soa_row_scalar(soa, labels + i, count - i, x + i, y);
+}
+
+__attribute__((target("avx2")))
+static void seed_soa_row_avx2(const Seed_Soa *soa, u32 *labels, u64 count, float x, float y) {
+    u64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_add_ps(_mm256_set1_ps(x + i), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 py = _mm256_set1_ps(y);
+
+        __m256 best_d  = _mm256_set1_ps(INFINITY);
+        __m256 best_id = _mm256_setzero_ps();
+
+        for (u64 k = 0; k < soa->count; k++) {
+            __m256 dx = _mm256_sub_ps(_mm256_broadcast_ss(&soa->xs[k]), px);
+            __m256 dy = _mm256_sub_ps(_mm256_broadcast_ss(&soa->ys[k]), py);
+            __m256 d  = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+            // the indexes ride along in float registers, blend doesnt care whats in them.
+            __m256 closer = _mm256_cmp_ps(d, best_d, _CMP_LT_OQ);
+            __m256 id     = _mm256_castsi256_ps(_mm256_set1_epi32(k));
+            best_d  = _mm256_min_ps(d, best_d);
+            best_id = _mm256_blendv_ps(best_id, id, closer);
+        }
+
+        _mm256_storeu_si256((__m256i *) &labels[i], _mm256_castps_si256(best_id));
+    }
+
+    seed_soa_row_scalar(soa, labels + i, count - i, x + i, y);
+}
+
+#define SEED_SOA_ROUND (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+__attribute__((target("avx512f")))
+static void seed_soa_row_avx512(const Seed_Soa *soa, u32 *labels, u64 count, float x, float y) {
+    for (u64 i = 0; i < count; i += 16) {
+        // the last few pixels of the row just get masked off.
+        __mmask16 active = count - i >= 16 ? 0xFFFF : (__mmask16) ((1u << (count - i)) - 1);
+
+        __m512 px = _mm512_add_ps(_mm512_set1_ps(x + i), _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        __m512 py = _mm512_set1_ps(y);
+
+        __m512  best_d  = _mm512_set1_ps(INFINITY);
+        __m512i best_id = _mm512_setzero_si512();
+
+        for (u64 k = 0; k < soa->count; k++) {
+            __m512 dx = _mm512_sub_ps(_mm512_set1_ps(soa->xs[k]), px);
+            __m512 dy = _mm512_sub_ps(_mm512_set1_ps(soa->ys[k]), py);
+            // AVX-512 comes with FMA, and the compiler likes to fuse a plain mul and add.
+            // it wont touch the ones with the rounding spelled out.
+            __m512 d  = _mm512_add_round_ps(_mm512_mul_round_ps(dx, dx, SEED_SOA_ROUND),
+                                            _mm512_mul_round_ps(dy, dy, SEED_SOA_ROUND), SEED_SOA_ROUND);
+
+            __mmask16 closer = _mm512_cmp_ps_mask(d, best_d, _CMP_LT_OQ);
+            best_d  = _mm512_mask_mov_ps(best_d, closer, d);
+            best_id = _mm512_mask_mov_epi32(best_id, closer, _mm512_set1_epi32(k));
+        }
+
+        _mm512_mask_storeu_epi32(&labels[i], active, best_id);
+    }
+}
+
+#endif // SEED_SOA_X86
+
+
+static void seed_soa_pick(Seed_Soa *soa) {
+    soa->nearest_row      = seed_soa_row_scalar;
+    soa->nearest_row_name = "scalar";
+
+#ifdef SEED_SOA_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        soa->nearest_row      = seed_soa_row_avx512;
+        soa->nearest_row_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        soa->nearest_row      = seed_soa_row_avx2;
+        soa->nearest_row_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        soa->nearest_row      = seed_soa_row_sse2;
+        soa->nearest_row_name = "sse2";
+    }
+#endif // SEED_SOA_X86
+}
+
+
+// room for 'num_points', whats already in there is lost.
+static void seed_soa_reserve(Seed_Soa *soa, u64 num_points) {
+    if (soa->nearest_row == NULL) seed_soa_pick(soa);
+
+    if (soa->capacity < num_points) {
+        // aligned_alloc() wants a multiple of the alignment
+        u64 per_line = SEED_SOA_ALIGN / sizeof(float);
+        soa->capacity = (num_points + per_line - 1) / per_line * per_line;
+
+        free(soa->xs);
+        free(soa->ys);
+        soa->xs = aligned_alloc(SEED_SOA_ALIGN, soa->capacity * sizeof(float));
+        soa->ys = aligned_alloc(SEED_SOA_ALIGN, soa->capacity * sizeof(float));
+        assert(soa->xs && soa->ys && "Buy More RAM lol");
+    }
+    soa->sorted = false;
+}
+
+// 'points' is x, y pairs.
+static void seed_soa_build(Seed_Soa *soa, const float *points, u64 num_points) {
+    seed_soa_reserve(soa, num_points);
+
+    for (u64 k = 0; k < num_points; k++) {
+        soa->xs[k] = points[2*k];
+        soa->ys[k] = points[2*k + 1];
+    }
+    soa->count = num_points;
+}
+
+// fills 'by_x', its an insertion sort so keep it to a few hundred points.
+static inline void seed_soa_sort(Seed_Soa *soa) {
+    if (soa->by_x_capacity < soa->count) {
+        soa->by_x_capacity = soa->capacity;
+        free(soa->by_x);
+        soa->by_x = malloc(soa->by_x_capacity * sizeof(u32));
+        assert(soa->by_x != NULL && "Buy More RAM lol");
+    }
+
+    for (u64 i = 0; i < soa->count; i++) {
+        u64 j = i;
+        for (; j > 0 && soa->xs[soa->by_x[j-1]] > soa->xs[i]; j--) soa->by_x[j] = soa->by_x[j-1];
+        soa->by_x[j] = i;
+    }
+    soa->sorted = true;
+}
+
+
+// smaller than this, checking the corners costs about as much as checking every pixel.
+#ifndef SEED_SOA_RECT_MIN
+#define SEED_SOA_RECT_MIN 8
+#endif
+
+// how much closer point k has to be at the corners, for the pixels between them to be sure.
+// (the distance to a pixel rounds a bit different than at the corners, this is way more than that)
+#define SEED_SOA_RECT_MARGIN 1e-5f
+
+// is every pixel of [x0, x1] x [y0, y1] closest to point k?
+// the distance to point o minus the distance to point k is linear in x and y,
+// so if its positive at all four corners, its positive everywhere between them.
+static inline bool seed_soa_rect_owned(const Seed_Soa *soa, u32 k, float x0, float y0, float x1, float y1) {
+    float cx[4] = {x0, x1, x0, x1};
+    float cy[4] = {y0, y0, y1, y1};
+    // a run along a row only has two
+    u64 corners = y0 == y1 ? 2 : 4;
+
+    float dk[4];
+    float max_dk = 0;
+    for (u64 c = 0; c < corners; c++) {
+        dk[c] = (soa->xs[k]-cx[c])*(soa->xs[k]-cx[c]) + (soa->ys[k]-cy[c])*(soa->ys[k]-cy[c]);
+        max_dk = fmaxf(max_dk, dk[c]);
+    }
+
+    for (u64 o = 0; o < soa->count; o++) {
+        if (o == k) continue;
+
+        float d[4];
+        float max_d = max_dk;
+        for (u64 c = 0; c < corners; c++) {
+            d[c] = (soa->xs[o]-cx[c])*(soa->xs[o]-cx[c]) + (soa->ys[o]-cy[c])*(soa->ys[o]-cy[c]);
+            max_d = fmaxf(max_d, d[c]);
+        }
+
+        // written so NaN's say no.
+        float margin = SEED_SOA_RECT_MARGIN * (max_d + max_dk);
+        for (u64 c = 0; c < corners; c++) {
+            if (!(d[c] - dk[c] > margin)) return false;
+        }
+    }
+
+    return true;
+}
+
+// labels [x0, x1) x [y0, y1), 'labels' points at (x0, y0) and has 'stride' between rows.
+// if 'row_d' isnt NULL, row_d[j - y0] is raised to the furthest any pixel of row j is from its point.
+static inline void seed_soa_rect(const Seed_Soa *soa, u32 *labels, u64 stride, u64 x0, u64 y0, u64 x1, u64 y1, float *row_d) {
+    if (x0 >= x1 || y0 >= y1) return;
+
+    if (x1 - x0 > SEED_SOA_RECT_MIN || y1 - y0 > SEED_SOA_RECT_MIN) {
+        float left = x0, right  = x1 - 1;
+        float top  = y0, bottom = y1 - 1;
+        u32 k = seed_soa_nearest(soa, left, top);
+
+        if (seed_soa_nearest(soa, right, top)    == k &&
+            seed_soa_nearest(soa, left,  bottom) == k &&
+            seed_soa_nearest(soa, right, bottom) == k &&
+            seed_soa_rect_owned(soa, k, left, top, right, bottom)) {
+            for (u64 j = y0; j < y1; j++) {
+                u32 *row = &labels[(j - y0) * stride];
+                for (u64 i = 0; i < x1 - x0; i++) row[i] = k;
+
+                if (row_d) {
+                    // and the furthest is at one of the ends
+                    float y = j;
+                    float dl = (soa->xs[k]-left) *(soa->xs[k]-left)  + (soa->ys[k]-y)*(soa->ys[k]-y);
+                    float dr = (soa->xs[k]-right)*(soa->xs[k]-right) + (soa->ys[k]-y)*(soa->ys[k]-y);
+                    row_d[j - y0] = fmaxf(row_d[j - y0], fmaxf(dl, dr));
+                }
+            }
+            return;
+        }
+
+        // split it in four, (or two, if its thin)
+        u64 xm = x1 - x0 > SEED_SOA_RECT_MIN ? x0 + (x1 - x0) / 2 : x1;
+        u64 ym = y1 - y0 > SEED_SOA_RECT_MIN ? y0 + (y1 - y0) / 2 : y1;
+        u32 *right_labels  = &labels[xm - x0];
+        u32 *bottom_labels = &labels[(ym - y0) * stride];
+        float *bottom_d = row_d ? &row_d[ym - y0] : NULL;
+
+        seed_soa_rect(soa, labels, stride, x0, y0, xm, ym, row_d);
+        seed_soa_rect(soa, right_labels, stride, xm, y0, x1, ym, row_d);
+        seed_soa_rect(soa, bottom_labels, stride, x0, ym, xm, y1, bottom_d);
+        seed_soa_rect(soa, bottom_labels + (xm - x0), stride, xm, ym, x1, y1, bottom_d);
+        return;
+    }
+
+    for (u64 j = y0; j < y1; j++) {
+        u32 *row = &labels[(j - y0) * stride];
+        soa->nearest_row(soa, row, x1 - x0, x0, j);
+
+        if (row_d) {
+            float y = j;
+            float d_max = row_d[j - y0];
+            for (u64 i = 0; i < x1 - x0; i++) {
+                u32 k = row[i];
+                float x = x0 + i;
+                float d = (soa->xs[k]-x)*(soa->xs[k]-x) + (soa->ys[k]-y)*(soa->ys[k]-y);
+                if (d_max < d) d_max = d;
+            }
+            row_d[j - y0] = d_max;
+        }
+    }
+}
+
+
+// more than this, and the spans dont fit on the stack. (and a grid is better anyway)
+#define SEED_SOA_SPANS_MAX 256
+
+// labels [x0, x1) x [y0, y1) a row at a time, 'labels' points at (x0, y0) and has 'stride' between rows.
+// needs seed_soa_sort(), without it (or with too many points) its seed_soa_rect().
+//
+// along row y, the distance to point k minus x*x is a line in x, (-2*px*x + px*px + (py-y)^2)
+// so the closest points along the row are the bottom of those lines, which is found
+// in one go over the points sorted by x. thats in doubles, and doesnt round like the
+// pixels do, so every run is checked with seed_soa_rect_owned() and shrunk until it passes.
+static inline void seed_soa_spans(const Seed_Soa *soa, u32 *labels, u64 stride, u64 x0, u64 y0, u64 x1, u64 y1) {
+    if (!soa->sorted || soa->count > SEED_SOA_SPANS_MAX) {
+        seed_soa_rect(soa, labels, stride, x0, y0, x1, y1, NULL);
+        return;
+    }
+
+    // the lines at the bottom, left to right, and where each one takes over.
+    u32    hull[SEED_SOA_SPANS_MAX];
+    double hull_start[SEED_SOA_SPANS_MAX];
+
+    for (u64 j = y0; j < y1; j++) {
+        u32 *row = &labels[(j - y0) * stride];
+        float y = j;
+
+        u64 count = 0;
+        for (u64 i = 0; i < soa->count; i++) {
+            u32 k = soa->by_x[i];
+            double slope = -2.0 * soa->xs[k];
+            double dy = (double) soa->ys[k] - y;
+            double height = (double) soa->xs[k]*soa->xs[k] + dy*dy;
+
+            while (count > 0) {
+                u32 top = hull[count - 1];
+                double top_slope  = -2.0 * soa->xs[top];
+                double top_dy     = (double) soa->ys[top] - y;
+                double top_height = (double) soa->xs[top]*soa->xs[top] + top_dy*top_dy;
+
+                double start;
+                if (slope == top_slope) {
+                    // same x, only the lower one (or the lower index) can ever be closest
+                    if (top_height <= height) goto next_point;
+                    start = -INFINITY;
+                } else {
+                    start = (height - top_height) / (top_slope - slope);
+                }
+
+                // it takes over before the top one does, so that one is never at the bottom.
+                if (count > 1 && start <= hull_start[count - 1]) {
+                    count--;
+                    continue;
+                }
+                if (count == 1 && start == -INFINITY) {
+                    count--;
+                    continue;
+                }
+
+                hull[count] = k;
+                hull_start[count] = start;
+                count++;
+                goto next_point;
+            }
+
+            hull[0] = k;
+            hull_start[0] = -INFINITY;
+            count = 1;
+
+        next_point:;
+        }
+
+        // NaN's mess it all up, but then nothing passes seed_soa_rect_owned() either.
+        u64 x = x0;
+        for (u64 h = 0; h < count && x < x1; h++) {
+            double end = h + 1 < count ? hull_start[h + 1] : INFINITY;
+            if (!(end > x)) continue;
+
+            // the run is [x, last]
+            u64 last = end >= x1 ? x1 - 1 : (u64) ceil(end) - 1;
+            if (last < x) last = x;
+            u32 k = hull[h];
+
+            u64 a = x, b = last;
+            while (a <= b) {
+                if (seed_soa_rect_owned(soa, k, a, y, b, y)) {
+                    for (u64 i = a; i <= b; i++) row[i - x0] = k;
+                    break;
+                }
+                row[a - x0] = seed_soa_nearest(soa, a, y);
+                a++;
+                if (a > b) break;
+                row[b - x0] = seed_soa_nearest(soa, b, y);
+                b--;
+            }
+
+            x = last + 1;
+        }
+        // whatever is left, if the lines went wrong
+        for (; x < x1; x++) row[x - x0] = seed_soa_nearest(soa, x, y);
+    }
+}
+
+
+static void seed_soa_free(Seed_Soa *soa) {
+    free(soa->xs);
+    free(soa->ys);
+    free(soa->by_x);
+    *soa = (Seed_Soa){0};
+}
+
+#endif // SEED_SOA_H_
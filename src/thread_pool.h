@@ -0,0 +1,439 @@
+//
+// thread_pool.h - one set of worker threads, shared by everything that wants them
+//
+// the threads are started once, and then sleep until there is work.
+// a parallel for hands out chunks of a range (or tiles of a rectangle)
+// with an atomic counter, and the calling thread works on them too.
+//
+// waking up is the slow part, so after a job the workers spin for a
+// little while, (the next job is often right behind) and only then
+// go to sleep on a futex. no barriers, no mutexes.
+//
+// the pool is reference counted, pool_start() and pool_stop() in every
+// init_voronoi() / finish_voronoi() and main(), and they all share it.
+//
+// #define THREAD_POOL_IMPLEMENTATION in exactly one file. (main.c / bench.c)
+// linux only, (futex)
+//
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stdio.h>
+
+#include "ints.h"
+
+
+// 'thread' is which thread is running it, in [0, pool_num_threads())
+// so it can be used to pick some per thread scratch space.
+typedef void Pool_Range_Fn(void *data, u64 start, u64 end, u64 thread);
+// the tile is [x0, x1) x [y0, y1)
+typedef void Pool_Tile_Fn(void *data, u64 x0, u64 y0, u64 x1, u64 y1, u64 thread);
+
+typedef struct Pool_Stats {
+    u64 num_threads;
+    u64 jobs;
+    // from pool_for() being called, to a worker starting on it.
+    u64 wakes;
+    double wake_mean_us;
+    double wake_max_us;
+} Pool_Stats;
+
+
+// the first one starts the threads, the last one stops them.
+void pool_start(void);
+void pool_stop(void);
+
+// the workers and the calling thread, 1 if the pool is not started.
+u64 pool_num_threads(void);
+
+// calls 'fn' on [0, count) in pieces of 'chunk_size', returns when its all done.
+// only one thread should be calling these, and not from inside a job.
+void pool_for(u64 count, u64 chunk_size, Pool_Range_Fn *fn, void *data);
+void pool_for_tiles(u64 width, u64 height, u64 tile_size, Pool_Tile_Fn *fn, void *data);
+
+Pool_Stats pool_get_stats(void);
+// the wake latency, and how busy every thread was.
+void pool_print_stats(FILE *stream);
+void pool_reset_stats(void);
+
+
+#endif // THREAD_POOL_H_
+
+
+#ifdef THREAD_POOL_IMPLEMENTATION
+
+#ifndef THREAD_POOL_IMPLEMENTATION_
+#define THREAD_POOL_IMPLEMENTATION_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "profiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POOL_PAUSE() _mm_pause()
+#else
+#define POOL_PAUSE()
+#endif // __x86_64__ || __i386__
+
+
+// how many threads, 0 is one per core, the VORONOI_THREADS environment variable wins.
+#ifndef POOL_NUM_THREADS
+#define POOL_NUM_THREADS 0
+#endif // POOL_NUM_THREADS
+
+// how long a worker spins after a job before going to sleep, in pauses. (about 100us)
+#ifndef POOL_SPIN_COUNT
+#define POOL_SPIN_COUNT 2048
+#endif // POOL_SPIN_COUNT
+
+
+typedef struct Pool_Job {
+    Pool_Range_Fn *range_fn;
+    Pool_Tile_Fn  *tile_fn;
+    void *data;
+
+    // how many pieces there are to hand out
+    u64 num_pieces;
+
+    // for pool_for()
+    u64 count;
+    u64 chunk_size;
+
+    // for pool_for_tiles()
+    u64 width, height;
+    u64 tile_size;
+    u64 tiles_x;
+
+    u64 dispatch_ns;
+} Pool_Job;
+
+// every thread writes only its own, and on its own cache line.
+// (idle_ns gets added up by the calling thread, once they all stopped)
+typedef struct Pool_Thread {
+    pthread_t id;
+    u64 jobs;
+    u64 pieces;
+    // working on pieces
+    u64 busy_ns;
+    // out of pieces, waiting for the last thread to finish
+    u64 idle_ns;
+    // when it ran out of pieces this job
+    u64 done_ns;
+} __attribute__((aligned(64))) Pool_Thread;
+
+typedef struct Pool {
+    u64 refs;
+    u64 num_threads;
+    Pool_Thread *threads;
+    bool spin;
+
+    Pool_Job job;
+    bool quit;
+
+    // bumped for every job, the sleeping workers wait on it.
+    _Atomic u32 generation;
+    _Atomic u32 sleepers;
+    // the next piece to hand out
+    _Atomic u64 next_piece;
+    // workers still on the current job, the caller waits on it.
+    _Atomic u32 working;
+
+    u64 jobs;
+    _Atomic u64 wakes;
+    _Atomic u64 wake_total_ns;
+    _Atomic u64 wake_max_ns;
+} Pool;
+
+static Pool pool = {0};
+
+
+static u64 pool_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pool_futex_wait(_Atomic u32 *address, u32 value) {
+    syscall(SYS_futex, (u32 *) address, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+static void pool_futex_wake(_Atomic u32 *address) {
+    syscall(SYS_futex, (u32 *) address, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// spin a little, then sleep, until '*address' is not 'value' anymore.
+static void pool_wait_while(_Atomic u32 *address, u32 value, _Atomic u32 *sleepers) {
+    if (pool.spin) {
+        for (u64 i = 0; i < POOL_SPIN_COUNT; i++) {
+            if (atomic_load(address) != value) return;
+            POOL_PAUSE();
+        }
+    }
+
+    // whoever changes it checks for sleepers after, so one of us sees the other.
+    if (sleepers) atomic_fetch_add(sleepers, 1);
+    while (atomic_load(address) == value) pool_futex_wait(address, value);
+    if (sleepers) atomic_fetch_sub(sleepers, 1);
+}
+
+
+static void pool_run_job(u64 thread) {
+    Pool_Job *job = &pool.job;
+    Pool_Thread *me = &pool.threads[thread];
+
+    u64 start = pool_now_ns();
+    u64 pieces = 0;
+
+    while (1) {
+        u64 piece = atomic_fetch_add_explicit(&pool.next_piece, 1, memory_order_relaxed);
+        if (piece >= job->num_pieces) break;
+
+        if (job->range_fn) {
+            u64 s = piece * job->chunk_size;
+            u64 e = s + job->chunk_size < job->count ? s + job->chunk_size : job->count;
+            job->range_fn(job->data, s, e, thread);
+        } else {
+            u64 x0 = (piece % job->tiles_x) * job->tile_size;
+            u64 y0 = (piece / job->tiles_x) * job->tile_size;
+            u64 x1 = x0 + job->tile_size < job->width  ? x0 + job->tile_size : job->width;
+            u64 y1 = y0 + job->tile_size < job->height ? y0 + job->tile_size : job->height;
+            job->tile_fn(job->data, x0, y0, x1, y1, thread);
+        }
+        pieces += 1;
+    }
+
+    u64 done = pool_now_ns();
+    me->jobs    += 1;
+    me->pieces  += pieces;
+    me->busy_ns += done - start;
+    me->done_ns  = done;
+}
+
+static void *pool_worker(void *args) {
+    u64 thread = (u64) args;
+    u32 seen = 0;
+
+    char name[32];
+    snprintf(name, sizeof(name), "pool thread %zu", thread);
+    PROFILER_NAME_THREAD(name);
+
+    while (1) {
+        // waiting for the next job, (or for the caller to get around to it)
+        PROFILER_ZONE("pool wait");
+            pool_wait_while(&pool.generation, seen, &pool.sleepers);
+        PROFILER_ZONE_END();
+        seen = atomic_load(&pool.generation);
+        if (pool.quit) break;
+
+        // dispatch to first work
+        u64 latency = pool_now_ns() - pool.job.dispatch_ns;
+        atomic_fetch_add_explicit(&pool.wakes, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool.wake_total_ns, latency, memory_order_relaxed);
+        u64 max = atomic_load_explicit(&pool.wake_max_ns, memory_order_relaxed);
+        while (latency > max && !atomic_compare_exchange_weak(&pool.wake_max_ns, &max, latency));
+
+        PROFILER_ZONE("pool job");
+            pool_run_job(thread);
+        PROFILER_ZONE_END();
+
+        // the last one out wakes the caller
+        if (atomic_fetch_sub(&pool.working, 1) == 1) pool_futex_wake(&pool.working);
+    }
+
+    return NULL;
+}
+
+
+void pool_start(void) {
+    pool.refs += 1;
+    if (pool.refs > 1) return;
+
+    u64 num_threads = POOL_NUM_THREADS;
+
+    const char *env = getenv("VORONOI_THREADS");
+    if (env && atoi(env) > 0) num_threads = atoi(env);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    if (num_threads == 0) num_threads = cores;
+
+    pool.num_threads = num_threads;
+    // with more threads than cores, a spinning thread is in the way of a working one.
+    pool.spin = num_threads <= (u64) cores && cores > 1;
+    pool.quit = false;
+    // the workers start out waiting for generation 0 to change.
+    atomic_store(&pool.generation, 0);
+
+    pool.threads = aligned_alloc(64, num_threads * sizeof(Pool_Thread));
+    assert(pool.threads != NULL && "Buy More RAM lol");
+    for (u64 i = 0; i < num_threads; i++) pool.threads[i] = (Pool_Thread){0};
+    pool_reset_stats();
+
+    // thread 0 is whoever calls pool_for()
+    for (u64 i = 1; i < num_threads; i++) {
+        int res = pthread_create(&pool.threads[i].id, NULL, pool_worker, (void *) i);
+        if (res) {
+            fprintf(stderr, "ERROR: thread could not be created\n");
+            exit(1);
+        }
+    }
+}
+
+void pool_stop(void) {
+    assert(pool.refs > 0);
+    pool.refs -= 1;
+    if (pool.refs > 0) return;
+
+    pool.quit = true;
+    atomic_fetch_add(&pool.generation, 1);
+    pool_futex_wake(&pool.generation);
+
+    // finish the treads
+    for (u64 i = 1; i < pool.num_threads; i++) {
+        int ret = pthread_join(pool.threads[i].id, NULL);
+        if (ret) {
+            fprintf(stderr, "ERROR: on id %zu when closeing\n", i);
+        }
+    }
+
+    free(pool.threads);
+    pool.threads = NULL;
+    pool.num_threads = 0;
+}
+
+u64 pool_num_threads(void) {
+    return pool.num_threads ? pool.num_threads : 1;
+}
+
+
+static void pool_dispatch(void) {
+    Pool_Job *job = &pool.job;
+
+    // not started, just do it here
+    if (pool.num_threads == 0) {
+        Pool_Thread thread = {0};
+        pool.threads = &thread;
+        PROFILER_ZONE("pool job");
+            pool_run_job(0);
+        PROFILER_ZONE_END();
+        pool.threads = NULL;
+        return;
+    }
+
+    pool.jobs += 1;
+    job->dispatch_ns = pool_now_ns();
+    atomic_store(&pool.next_piece, 0);
+    atomic_store(&pool.working, pool.num_threads - 1);
+
+    atomic_fetch_add(&pool.generation, 1);
+    if (atomic_load(&pool.sleepers) > 0) pool_futex_wake(&pool.generation);
+
+    PROFILER_ZONE("pool job");
+        pool_run_job(0);
+    PROFILER_ZONE_END();
+
+    // out of pieces, waiting on the slowest worker
+    PROFILER_ZONE("pool barrier");
+        u32 working;
+        while ((working = atomic_load(&pool.working)) != 0) {
+            pool_wait_while(&pool.working, working, NULL);
+        }
+    PROFILER_ZONE_END();
+
+    // everyone waited for the slowest one
+    u64 last_done = 0;
+    for (u64 i = 0; i < pool.num_threads; i++) {
+        if (last_done < pool.threads[i].done_ns) last_done = pool.threads[i].done_ns;
+    }
+    for (u64 i = 0; i < pool.num_threads; i++) {
+        pool.threads[i].idle_ns += last_done - pool.threads[i].done_ns;
+    }
+}
+
+void pool_for(u64 count, u64 chunk_size, Pool_Range_Fn *fn, void *data) {
+    if (count == 0) return;
+    if (chunk_size == 0) chunk_size = 1;
+
+    pool.job = (Pool_Job){
+        .range_fn   = fn,
+        .data       = data,
+        .num_pieces = (count + chunk_size - 1) / chunk_size,
+        .count      = count,
+        .chunk_size = chunk_size,
+    };
+    pool_dispatch();
+}
+
+void pool_for_tiles(u64 width, u64 height, u64 tile_size, Pool_Tile_Fn *fn, void *data) {
+    if (width == 0 || height == 0) return;
+    if (tile_size == 0) tile_size = 1;
+
+    u64 tiles_x = (width  + tile_size - 1) / tile_size;
+    u64 tiles_y = (height + tile_size - 1) / tile_size;
+
+    pool.job = (Pool_Job){
+        .tile_fn    = fn,
+        .data       = data,
+        .num_pieces = tiles_x * tiles_y,
+        .width      = width,
+        .height     = height,
+        .tile_size  = tile_size,
+        .tiles_x    = tiles_x,
+    };
+    pool_dispatch();
+}
+
+
+Pool_Stats pool_get_stats(void) {
+    Pool_Stats stats = {0};
+    stats.num_threads  = pool_num_threads();
+    stats.jobs         = pool.jobs;
+    stats.wakes        = atomic_load(&pool.wakes);
+    stats.wake_mean_us = stats.wakes ? atomic_load(&pool.wake_total_ns) / 1e3 / stats.wakes : 0;
+    stats.wake_max_us  = atomic_load(&pool.wake_max_ns) / 1e3;
+    return stats;
+}
+
+void pool_print_stats(FILE *stream) {
+    Pool_Stats stats = pool_get_stats();
+    fprintf(stream, "INFO: pool: %zu threads, %zu jobs, wake latency %.1f us mean, %.1f us max\n",
+            stats.num_threads, stats.jobs, stats.wake_mean_us, stats.wake_max_us);
+
+    for (u64 i = 0; i < pool.num_threads; i++) {
+        Pool_Thread thread = pool.threads[i];
+        if (thread.jobs == 0) continue;
+
+        u64 total = thread.busy_ns + thread.idle_ns;
+        fprintf(stream, "INFO: thread %2zu: %8zu pieces, %5.1f%% idle, %10.3f ms busy\n",
+                i, thread.pieces, total ? 100.0 * thread.idle_ns / total : 0.0, thread.busy_ns / 1e6);
+    }
+}
+
+void pool_reset_stats(void) {
+    pool.jobs = 0;
+    atomic_store(&pool.wakes, 0);
+    atomic_store(&pool.wake_total_ns, 0);
+    atomic_store(&pool.wake_max_ns, 0);
+
+    for (u64 i = 0; i < pool.num_threads; i++) {
+        pool.threads[i].jobs    = 0;
+        pool.threads[i].pieces  = 0;
+        pool.threads[i].busy_ns = 0;
+        pool.threads[i].idle_ns = 0;
+    }
+}
+
+#endif // THREAD_POOL_IMPLEMENTATION_
+
+#endif // THREAD_POOL_IMPLEMENTATION
@@ -0,0 +1,262 @@
+//
+// trajectory.h - record where every point was, every frame, and play it back
+//
+// the points in main.c come from rand(), and move by however long the last
+// frame took, so no two runs are the same. a recording has what was actually
+// drawn, so every backend can be run on the exact same frames.
+//
+// the file is a header, then one frame after another:
+//
+//     header: "VTRJ", u32 version, u32 width, u32 height, u64 num_frames, u64 0
+//     frame:  u32 width, u32 height, f32 delta, u32 num_points,
+//             u32 num_new, u8 rgba[num_new], (the colors of the last num_new points)
+//             f32 xy[num_points]
+//
+// points only ever get added to, or cut off, the end. so only the colors of
+// the ones that are new since the last frame are in there. (little endian,
+// everything 4 byte aligned, so the points can be used straight from the mmap)
+//
+// #define TRAJECTORY_IMPLEMENTATION in exactly one file.
+// linux only, (mmap)
+//
+
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "ints.h"
+
+#define TRAJECTORY_MAGIC   "VTRJ"
+#define TRAJECTORY_VERSION 1
+
+typedef struct Trajectory_Writer {
+    FILE *file;
+    u64 num_frames;
+    // so only the new colors get written
+    u64 last_num_points;
+    bool failed;
+} Trajectory_Writer;
+
+typedef struct Trajectory_Frame {
+    u32 width, height;
+    float delta;
+    u64 num_points;
+    // x, y pairs, (a Vector2 array) right out of the file
+    const float *points;
+    // rgba, (a Color array) every point so far, not just the new ones
+    const u8 *colors;
+} Trajectory_Frame;
+
+typedef struct Trajectory {
+    const u8 *data;
+    u64 size;
+
+    // from the header
+    u32 width, height;
+    u64 num_frames;
+
+    // where the next frame starts
+    u64 offset;
+    u64 frame;
+
+    // the colors are put back together here
+    u8 *colors;
+    u64 colors_capacity;
+} Trajectory;
+
+
+// false if the file couldnt be opened, (errno says why)
+bool trajectory_record_start(Trajectory_Writer *writer, const char *path, u32 width, u32 height);
+// 'colors' is rgba, num_points of them. false if writing failed, (and every frame after)
+bool trajectory_record_frame(Trajectory_Writer *writer, u32 width, u32 height, float delta,
+                             const float *points, const u8 *colors, u64 num_points);
+// puts the number of frames in the header, false if anything failed.
+bool trajectory_record_stop(Trajectory_Writer *writer);
+
+// maps the whole file, false if it cant, or its not a recording. (prints why)
+bool trajectory_open(Trajectory *trajectory, const char *path);
+// the next frame, false when there are no more. (or the rest of the file is broken)
+// the frame is good until the next call.
+bool trajectory_next(Trajectory *trajectory, Trajectory_Frame *frame);
+// back to the first frame
+void trajectory_rewind(Trajectory *trajectory);
+void trajectory_close(Trajectory *trajectory);
+
+#endif // TRAJECTORY_H_
+
+
+#ifdef TRAJECTORY_IMPLEMENTATION
+
+#ifndef TRAJECTORY_IMPLEMENTATION_
+#define TRAJECTORY_IMPLEMENTATION_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRAJECTORY_HEADER_SIZE 32
+#define TRAJECTORY_FRAME_SIZE  20
+
+static void trajectory_write(Trajectory_Writer *writer, const void *data, u64 size) {
+    if (writer->failed || size == 0) return;
+    if (fwrite(data, 1, size, writer->file) != size) writer->failed = true;
+}
+
+static void trajectory_write_header(Trajectory_Writer *writer, u32 width, u32 height) {
+    u32 version = TRAJECTORY_VERSION;
+    u64 zero = 0;
+
+    trajectory_write(writer, TRAJECTORY_MAGIC, 4);
+    trajectory_write(writer, &version, sizeof(version));
+    trajectory_write(writer, &width,   sizeof(width));
+    trajectory_write(writer, &height,  sizeof(height));
+    trajectory_write(writer, &writer->num_frames, sizeof(writer->num_frames));
+    trajectory_write(writer, &zero, sizeof(zero));
+}
+
+bool trajectory_record_start(Trajectory_Writer *writer, const char *path, u32 width, u32 height) {
+    *writer = (Trajectory_Writer){0};
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file) return false;
+
+    trajectory_write_header(writer, width, height);
+    return !writer->failed;
+}
+
+bool trajectory_record_frame(Trajectory_Writer *writer, u32 width, u32 height, float delta,
+                             const float *points, const u8 *colors, u64 num_points) {
+    u32 count   = num_points;
+    u32 num_new = num_points > writer->last_num_points ? num_points - writer->last_num_points : 0;
+    assert(count == num_points && "too many points for a recording");
+
+    trajectory_write(writer, &width,   sizeof(width));
+    trajectory_write(writer, &height,  sizeof(height));
+    trajectory_write(writer, &delta,   sizeof(delta));
+    trajectory_write(writer, &count,   sizeof(count));
+    trajectory_write(writer, &num_new, sizeof(num_new));
+    trajectory_write(writer, colors + 4*(num_points - num_new), 4*num_new);
+    trajectory_write(writer, points, 2*num_points * sizeof(float));
+
+    writer->last_num_points = num_points;
+    if (!writer->failed) writer->num_frames += 1;
+    return !writer->failed;
+}
+
+bool trajectory_record_stop(Trajectory_Writer *writer) {
+    // now that its known
+    if (!writer->failed) {
+        if (fseek(writer->file, 16, SEEK_SET) != 0) writer->failed = true;
+        trajectory_write(writer, &writer->num_frames, sizeof(writer->num_frames));
+    }
+
+    if (fclose(writer->file) != 0) writer->failed = true;
+    writer->file = NULL;
+    return !writer->failed;
+}
+
+
+bool trajectory_open(Trajectory *trajectory, const char *path) {
+    *trajectory = (Trajectory){0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (u64) info.st_size < TRAJECTORY_HEADER_SIZE) {
+        fprintf(stderr, "ERROR: '%s' is too small to be a recording\n", path);
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    // its read front to back, once.
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    trajectory->data = data;
+    trajectory->size = info.st_size;
+
+    u32 version;
+    memcpy(&version, trajectory->data + 4, sizeof(version));
+    if (memcmp(trajectory->data, TRAJECTORY_MAGIC, 4) != 0 || version != TRAJECTORY_VERSION) {
+        fprintf(stderr, "ERROR: '%s' is not a recording, (or its from a different version)\n", path);
+        trajectory_close(trajectory);
+        return false;
+    }
+
+    memcpy(&trajectory->width,      trajectory->data +  8, sizeof(trajectory->width));
+    memcpy(&trajectory->height,     trajectory->data + 12, sizeof(trajectory->height));
+    memcpy(&trajectory->num_frames, trajectory->data + 16, sizeof(trajectory->num_frames));
+
+    trajectory_rewind(trajectory);
+    return true;
+}
+
+bool trajectory_next(Trajectory *trajectory, Trajectory_Frame *frame) {
+    // 0 frames is a recording that never got stopped, so it goes until the file runs out
+    if (trajectory->num_frames && trajectory->frame >= trajectory->num_frames) return false;
+
+    const u8 *at = trajectory->data + trajectory->offset;
+    u64 left = trajectory->size - trajectory->offset;
+    if (left < TRAJECTORY_FRAME_SIZE) return false;
+
+    u32 count, num_new;
+    memcpy(&frame->width,  at +  0, sizeof(frame->width));
+    memcpy(&frame->height, at +  4, sizeof(frame->height));
+    memcpy(&frame->delta,  at +  8, sizeof(frame->delta));
+    memcpy(&count,         at + 12, sizeof(count));
+    memcpy(&num_new,       at + 16, sizeof(num_new));
+
+    u64 size = TRAJECTORY_FRAME_SIZE + 4*(u64) num_new + 2*(u64) count * sizeof(float);
+    if (num_new > count || left < size) {
+        fprintf(stderr, "ERROR: frame %zu of the recording is cut off\n", trajectory->frame);
+        return false;
+    }
+
+    if (trajectory->colors_capacity < count) {
+        trajectory->colors_capacity = count * 2;
+        trajectory->colors = realloc(trajectory->colors, 4*trajectory->colors_capacity);
+        assert(trajectory->colors != NULL && "Buy More RAM lol");
+    }
+    memcpy(trajectory->colors + 4*(count - num_new), at + TRAJECTORY_FRAME_SIZE, 4*num_new);
+
+    frame->num_points = count;
+    frame->points = (const float *) (at + TRAJECTORY_FRAME_SIZE + 4*num_new);
+    frame->colors = trajectory->colors;
+
+    trajectory->offset += size;
+    trajectory->frame  += 1;
+    return true;
+}
+
+void trajectory_rewind(Trajectory *trajectory) {
+    trajectory->offset = TRAJECTORY_HEADER_SIZE;
+    trajectory->frame  = 0;
+}
+
+void trajectory_close(Trajectory *trajectory) {
+    if (trajectory->data) munmap((void *) trajectory->data, trajectory->size);
+    free(trajectory->colors);
+    *trajectory = (Trajectory){0};
+}
+
+#endif // TRAJECTORY_IMPLEMENTATION_
+
+#endif // TRAJECTORY_IMPLEMENTATION
@@ -2,14 +2,15 @@
 #ifndef VORONOI_H_
 #define VORONOI_H_
 
-#include "raylib.h"
+#include "voronoi_compute.h"
 
-typedef unsigned long size_t;
+// VORONOI_HEADLESS builds leave this out, so they dont need raylib or a window
+#ifndef VORONOI_HEADLESS
 
-void init_voronoi(void);
+#include "raylib.h"
 
 void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points);
 
-void finish_voronoi(void);
+#endif // VORONOI_HEADLESS
 
 #endif // VORONOI_H_
@@ -0,0 +1,39 @@
+
+#ifndef VORONOI_COMPUTE_H_
+#define VORONOI_COMPUTE_H_
+
+// the part of the backends that doesnt need raylib, or a window.
+// only the CPU backends implement this.
+
+#include <stddef.h>
+
+#include "ints.h"
+
+
+// the bench links every backend into the same binary,
+// so it compiles each one with a different prefix.
+#ifdef VORONOI_PREFIX
+    #define VORONOI_CONCAT_(a, b) a##b
+    #define VORONOI_CONCAT(a, b)  VORONOI_CONCAT_(a, b)
+
+    #define init_voronoi    VORONOI_CONCAT(VORONOI_PREFIX, init_voronoi)
+    #define compute_voronoi VORONOI_CONCAT(VORONOI_PREFIX, compute_voronoi)
+    #define finish_voronoi  VORONOI_CONCAT(VORONOI_PREFIX, finish_voronoi)
+#endif // VORONOI_PREFIX
+
+
+// label of a pixel that no point owns,
+// (with_math can leave small gaps between cells)
+#define VORONOI_NO_LABEL ((u32) -1)
+
+
+void init_voronoi(void);
+
+// fills 'labels' (width*height, top row first) with the index of the closest point.
+//
+// 'points' is x, y pairs, the same layout as a raylib Vector2 array.
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points);
+
+void finish_voronoi(void);
+
+#endif // VORONOI_COMPUTE_H_
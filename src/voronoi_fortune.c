@@ -0,0 +1,587 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "voronoi.h"
+
+#include "common.h"
+
+#include "polygon.h"
+
+
+// Fortune's algorithm: https://en.wikipedia.org/wiki/Fortune%27s_algorithm
+//
+// a line sweeps down the screen, the points above it are done.
+// every done point has a parabola of the places that are as close
+// to it as to the sweep line, and the lowest of all these parabolas
+// is the 'beach line'. the beach line is made of arcs, and the places
+// where two arcs meet trace out the edges of the diagram.
+//
+// 1. Sort the points from top to bottom.
+// 2. When the sweep line hits a point, (site event)
+//        split the arc above it, and put the new points arc in the middle.
+// 3. When an arc shrinks to nothing, (circle event)
+//        remove it, its neighbors are now next to each other.
+// 4. Every two points that were ever next to each other on the beach line
+//        share an edge, so they are neighbors.
+// 5. For every point, cut the screen with the mid lines of just its neighbors,
+//        which leaves its exact cell, clipped to the screen.
+//
+// finding the arc above a point is a search on the beach line, which is
+// a skip list here, so the whole sweep is O(n*log(n)).
+//
+// y goes down, so the sweep line goes from y = 0 to y = height.
+
+
+#define NIL ((u32) -1)
+
+// the first arc in the list, it has no point, its only there to point at the real ones.
+#define BEACH_HEAD 0
+// more than enough for 2^20 arcs, anything past that is just a bit slower.
+#define BEACH_MAX_LEVEL 20
+
+typedef struct Arc {
+    u32 site;
+    // its circle event in 'events', if any
+    u32 event;
+
+    u32 height;
+    u32 next[BEACH_MAX_LEVEL];
+    u32 prev[BEACH_MAX_LEVEL];
+} Arc;
+
+typedef struct Circle_Event {
+    // where the sweep line is when the arc disappears
+    double x, y;
+    u32 arc;
+    // the arc it was for changed, so this doesnt happen anymore.
+    bool valid;
+} Circle_Event;
+
+
+// all the arrays are global variables, so they keep their malloc's between draw calls.
+
+// the points as doubles, (a polygon, because its already a double vector2 array)
+static Polygon sites = {0};
+// the points in the order the sweep line hits them.
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} sorted_sites = {0};
+// a point on top of a point with a lower index, it doesnt get a cell.
+static struct {
+    bool *items;
+    u64 count;
+    u64 capacity;
+} site_is_copy = {0};
+
+// the arcs, deleted arcs are reused
+static struct {
+    Arc *items;
+    u64 count;
+    u64 capacity;
+} arcs = {0};
+static u32 free_arc = NIL;
+
+// every event, and a min heap (on y) of the ones that havent happened yet.
+static struct {
+    Circle_Event *items;
+    u64 count;
+    u64 capacity;
+} events = {0};
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} free_events = {0}, event_heap = {0};
+
+// every pair of points that were next to each other on the beach line.
+// (the same pair can be in here more than once, thats fine)
+typedef struct Neighbor_Pair {
+    u32 a, b;
+} Neighbor_Pair;
+static struct {
+    Neighbor_Pair *items;
+    u64 count;
+    u64 capacity;
+} neighbor_pairs = {0};
+
+// the neighbors of point 'i' are neighbors[neighbor_start[i] .. neighbor_start[i+1]]
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} neighbor_start = {0}, neighbors = {0};
+
+static double sweep_y;
+static u64 beach_random;
+
+// the polygons for the cells
+static Polygon polygon   = {0};
+static Polygon tmp_poly  = {0};
+
+
+void init_voronoi(void) {}
+
+void finish_voronoi(void) {
+    da_free(&sites);
+    da_free(&sorted_sites);
+    da_free(&site_is_copy);
+    da_free(&arcs);
+    da_free(&events);
+    da_free(&free_events);
+    da_free(&event_heap);
+    da_free(&neighbor_pairs);
+    da_free(&neighbor_start);
+    da_free(&neighbors);
+
+    da_free(&polygon);
+    da_free(&tmp_poly);
+}
+
+
+// ---------------------------------------------------
+//              The beach line
+// ---------------------------------------------------
+
+static DoubleVector2 arc_site(u32 arc) {
+    return sites.items[arcs.items[arc].site];
+}
+
+// x of where the arc of 'p' (on the left) meets the arc of 'q' (on the right)
+static double breakpoint_x(DoubleVector2 p, DoubleVector2 q, double l) {
+    // the same height, the arcs are the same shape, so its half way.
+    if (p.y == q.y) return (p.x + q.x) / 2;
+    // a point on the sweep line is a straight line up.
+    if (p.y == l) return p.x;
+    if (q.y == l) return q.x;
+
+    // the parabola of a point is y = ((x - p.x)^2 + p.y^2 - l^2) / (2*(p.y - l)),
+    // set them equal, and solve a*x^2 + b*x + c = 0
+    double dp = 2*(p.y - l);
+    double dq = 2*(q.y - l);
+
+    double a = 1/dp - 1/dq;
+    double b = -2*(p.x/dp - q.x/dq);
+    double c = (p.x*p.x + p.y*p.y - l*l)/dp - (q.x*q.x + q.y*q.y - l*l)/dq;
+
+    double disc = b*b - 4*a*c;
+    if (disc < 0) disc = 0;
+
+    double x1 = (-b - sqrt(disc)) / (2*a);
+    double x2 = (-b + sqrt(disc)) / (2*a);
+    if (x2 < x1) SWAP(x1, x2);
+
+    // the point closer to the sweep line has the thinner parabola,
+    // which is the one on the beach line between the two crossings.
+    return p.y > q.y ? x2 : x1;
+}
+
+// where this arc starts
+static double arc_left_x(u32 arc) {
+    u32 prev = arcs.items[arc].prev[0];
+    if (prev == BEACH_HEAD) return -INFINITY;
+    return breakpoint_x(arc_site(prev), arc_site(arc), sweep_y);
+}
+
+// the arc that is above 'x'
+static u32 beach_find(double x) {
+    u32 arc = BEACH_HEAD;
+    for (s64 level = BEACH_MAX_LEVEL-1; level >= 0; level--) {
+        while (1) {
+            u32 next = arcs.items[arc].next[level];
+            if (next == NIL || arc_left_x(next) > x) break;
+            arc = next;
+        }
+    }
+    return arc;
+}
+
+static u32 beach_random_height(void) {
+    // xorshift
+    beach_random ^= beach_random << 13;
+    beach_random ^= beach_random >> 7;
+    beach_random ^= beach_random << 17;
+
+    // half of the arcs get to the next level
+    return __builtin_ctzll(beach_random | (1ull << (BEACH_MAX_LEVEL-1))) + 1;
+}
+
+static u32 beach_insert_after(u32 after, u32 site) {
+    u32 arc;
+    if (free_arc != NIL) {
+        arc = free_arc;
+        free_arc = arcs.items[arc].next[0];
+    } else {
+        da_append(&arcs, ((Arc){0}));
+        arc = arcs.count - 1;
+    }
+
+    Arc *new_arc = &arcs.items[arc];
+    new_arc->site   = site;
+    new_arc->event  = NIL;
+    new_arc->height = beach_random_height();
+
+    // on every level, link it after the closest arc that is that tall.
+    u32 prev = after;
+    for (u32 level = 0; level < new_arc->height; level++) {
+        while (arcs.items[prev].height <= level) prev = arcs.items[prev].prev[level-1];
+
+        u32 next = arcs.items[prev].next[level];
+        new_arc->prev[level] = prev;
+        new_arc->next[level] = next;
+        arcs.items[prev].next[level] = arc;
+        if (next != NIL) arcs.items[next].prev[level] = arc;
+    }
+
+    return arc;
+}
+
+static void beach_remove(u32 arc) {
+    Arc *old_arc = &arcs.items[arc];
+    for (u32 level = 0; level < old_arc->height; level++) {
+        u32 prev = old_arc->prev[level];
+        u32 next = old_arc->next[level];
+        arcs.items[prev].next[level] = next;
+        if (next != NIL) arcs.items[next].prev[level] = prev;
+    }
+
+    old_arc->next[0] = free_arc;
+    free_arc = arc;
+}
+
+
+// ---------------------------------------------------
+//              The circle events
+// ---------------------------------------------------
+
+static bool event_before(u32 a, u32 b) {
+    Circle_Event *e1 = &events.items[a];
+    Circle_Event *e2 = &events.items[b];
+    if (e1->y != e2->y) return e1->y < e2->y;
+    return e1->x < e2->x;
+}
+
+static void heap_push(u32 event) {
+    da_append(&event_heap, event);
+
+    u64 i = event_heap.count - 1;
+    while (i > 0) {
+        u64 parent = (i - 1) / 2;
+        if (!event_before(event_heap.items[i], event_heap.items[parent])) break;
+        SWAP(event_heap.items[i], event_heap.items[parent]);
+        i = parent;
+    }
+}
+
+static u32 heap_pop(void) {
+    assert(event_heap.count > 0);
+    u32 top = event_heap.items[0];
+    event_heap.items[0] = event_heap.items[--event_heap.count];
+
+    u64 i = 0;
+    while (1) {
+        u64 smallest = i;
+        u64 left  = 2*i + 1;
+        u64 right = 2*i + 2;
+        if (left  < event_heap.count && event_before(event_heap.items[left],  event_heap.items[smallest])) smallest = left;
+        if (right < event_heap.count && event_before(event_heap.items[right], event_heap.items[smallest])) smallest = right;
+        if (smallest == i) break;
+        SWAP(event_heap.items[i], event_heap.items[smallest]);
+        i = smallest;
+    }
+
+    return top;
+}
+
+// the arc changed, so its circle event is wrong now.
+static void invalidate_event(u32 arc) {
+    u32 event = arcs.items[arc].event;
+    if (event == NIL) return;
+    events.items[event].valid = false;
+    arcs.items[arc].event = NIL;
+}
+
+// if the arc is going to be squeezed out by its neighbors, add an event for it.
+static void check_circle_event(u32 arc) {
+    u32 prev = arcs.items[arc].prev[0];
+    u32 next = arcs.items[arc].next[0];
+    if (prev == BEACH_HEAD || next == NIL) return;
+    if (arcs.items[prev].site == arcs.items[next].site) return;
+
+    DoubleVector2 a = arc_site(prev);
+    DoubleVector2 b = arc_site(arc);
+    DoubleVector2 c = arc_site(next);
+
+    // the edges on both sides only meet if the points turn this way,
+    // (clockwise with y going up, y goes down here so its the other way)
+    double cross = (b.x - a.x)*(c.y - b.y) - (b.y - a.y)*(c.x - b.x);
+    if (cross <= 0) return;
+
+    // the center of the circle through the 3 points is where the edges meet,
+    // https://en.wikipedia.org/wiki/Circumcircle#Cartesian_coordinates_2
+    double bx = b.x - a.x, by = b.y - a.y;
+    double cx = c.x - a.x, cy = c.y - a.y;
+    double d  = 2*(bx*cy - by*cx);
+    double ux = (cy*(bx*bx + by*by) - by*(cx*cx + cy*cy)) / d;
+    double uy = (bx*(cx*cx + cy*cy) - cx*(bx*bx + by*by)) / d;
+    double radius = sqrt(ux*ux + uy*uy);
+
+    Circle_Event event = {
+        .x = a.x + ux,
+        // the arc goes away when the sweep line gets to the bottom of the circle
+        .y = a.y + uy + radius,
+        .arc = arc,
+        .valid = true,
+    };
+
+    u32 index;
+    if (free_events.count > 0) {
+        index = free_events.items[--free_events.count];
+        events.items[index] = event;
+    } else {
+        da_append(&events, event);
+        index = events.count - 1;
+    }
+
+    arcs.items[arc].event = index;
+    heap_push(index);
+}
+
+
+// ---------------------------------------------------
+//                  The sweep
+// ---------------------------------------------------
+
+static void add_neighbors(u32 arc1, u32 arc2) {
+    da_append(&neighbor_pairs, ((Neighbor_Pair){arcs.items[arc1].site, arcs.items[arc2].site}));
+}
+
+static void site_event(u32 site) {
+    // the first point
+    if (arcs.items[BEACH_HEAD].next[0] == NIL) {
+        beach_insert_after(BEACH_HEAD, site);
+        return;
+    }
+
+    u32 arc = beach_find(sites.items[site].x);
+    assert(arc != BEACH_HEAD);
+
+    if (arc_site(arc).y == sites.items[site].y) {
+        // the arc is on the sweep line too, (only happens for points with the same y)
+        // so its a straight line up, there is nothing to split.
+        // the points are sorted by x, so the new one goes on the right.
+        u32 next = arcs.items[arc].next[0];
+
+        invalidate_event(arc);
+        if (next != NIL) invalidate_event(next);
+
+        u32 new_arc = beach_insert_after(arc, site);
+        add_neighbors(arc, new_arc);
+        if (next != NIL) add_neighbors(new_arc, next);
+
+        check_circle_event(arc);
+        check_circle_event(new_arc);
+        if (next != NIL) check_circle_event(next);
+        return;
+    }
+
+    // split the arc in two, with the new one in between
+    invalidate_event(arc);
+
+    u32 new_arc   = beach_insert_after(arc, site);
+    u32 right_arc = beach_insert_after(new_arc, arcs.items[arc].site);
+    add_neighbors(arc, new_arc);
+
+    check_circle_event(arc);
+    check_circle_event(right_arc);
+}
+
+static void circle_event(u32 event) {
+    u32 arc  = events.items[event].arc;
+    u32 prev = arcs.items[arc].prev[0];
+    u32 next = arcs.items[arc].next[0];
+
+    invalidate_event(prev);
+    invalidate_event(next);
+    arcs.items[arc].event = NIL;
+
+    beach_remove(arc);
+    add_neighbors(prev, next);
+
+    check_circle_event(prev);
+    check_circle_event(next);
+}
+
+static int compare_sites(const void *a, const void *b) {
+    u32 i = *(const u32 *) a;
+    u32 j = *(const u32 *) b;
+    DoubleVector2 p = sites.items[i];
+    DoubleVector2 q = sites.items[j];
+
+    if (p.y != q.y) return p.y < q.y ? -1 : 1;
+    if (p.x != q.x) return p.x < q.x ? -1 : 1;
+    // the same point twice, the lower index gets the cell
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+// steps 1-4, leaves the neighbors of every point in 'neighbors'
+static void build_diagram(const float *points, size_t num_points) {
+    sites.count = 0;
+    sorted_sites.count = 0;
+    site_is_copy.count = 0;
+    for (u64 i = 0; i < num_points; i++) {
+        da_append(&sites, ((DoubleVector2){(double)points[2*i], (double)points[2*i + 1]}));
+        da_append(&sorted_sites, i);
+        da_append(&site_is_copy, false);
+    }
+
+    // 1. Sort the points from top to bottom.
+    qsort(sorted_sites.items, sorted_sites.count, sizeof(u32), compare_sites);
+
+    for (u64 k = 1; k < num_points; k++) {
+        DoubleVector2 p = sites.items[sorted_sites.items[k-1]];
+        DoubleVector2 q = sites.items[sorted_sites.items[k  ]];
+        if (p.x == q.x && p.y == q.y) site_is_copy.items[sorted_sites.items[k]] = true;
+    }
+
+
+    // reset the beach line, and the events
+    arcs.count = 0;
+    free_arc = NIL;
+    da_append(&arcs, ((Arc){0}));
+    arcs.items[BEACH_HEAD].height = BEACH_MAX_LEVEL;
+    for (u64 level = 0; level < BEACH_MAX_LEVEL; level++) arcs.items[BEACH_HEAD].next[level] = NIL;
+
+    events.count = 0;
+    free_events.count = 0;
+    event_heap.count = 0;
+    neighbor_pairs.count = 0;
+
+    // the same every frame, so the frames take the same time
+    beach_random = 0x9E3779B97F4A7C15;
+
+
+    u64 next_site = 0;
+    while (next_site < num_points || event_heap.count > 0) {
+        bool is_circle_event = event_heap.count > 0 && (
+            next_site == num_points ||
+            events.items[event_heap.items[0]].y < sites.items[sorted_sites.items[next_site]].y
+        );
+
+        if (is_circle_event) {
+            // 3. When an arc shrinks to nothing, (circle event)
+            u32 event = heap_pop();
+            if (events.items[event].valid) {
+                sweep_y = events.items[event].y;
+                circle_event(event);
+            }
+            da_append(&free_events, event);
+
+        } else {
+            // 2. When the sweep line hits a point, (site event)
+            u32 site = sorted_sites.items[next_site++];
+            if (site_is_copy.items[site]) continue;
+
+            sweep_y = sites.items[site].y;
+            site_event(site);
+        }
+    }
+
+
+    // 4. turn the pairs into a list of neighbors for every point (counting sort)
+    neighbor_start.count = 0;
+    for (u64 i = 0; i < num_points + 1; i++) da_append(&neighbor_start, 0);
+
+    for (u64 k = 0; k < neighbor_pairs.count; k++) {
+        neighbor_start.items[neighbor_pairs.items[k].a + 1] += 1;
+        neighbor_start.items[neighbor_pairs.items[k].b + 1] += 1;
+    }
+    for (u64 i = 0; i < num_points; i++) neighbor_start.items[i+1] += neighbor_start.items[i];
+
+    neighbors.count = 0;
+    for (u64 k = 0; k < 2*neighbor_pairs.count; k++) da_append(&neighbors, 0);
+
+    // uses neighbor_start[i] as a cursor, shift it back afterwards.
+    for (u64 k = 0; k < neighbor_pairs.count; k++) {
+        u32 a = neighbor_pairs.items[k].a;
+        u32 b = neighbor_pairs.items[k].b;
+        neighbors.items[neighbor_start.items[a]++] = b;
+        neighbors.items[neighbor_start.items[b]++] = a;
+    }
+    for (u64 i = num_points; i > 0; i--) neighbor_start.items[i] = neighbor_start.items[i-1];
+    neighbor_start.items[0] = 0;
+}
+
+
+// ---------------------------------------------------
+//                  The cells
+// ---------------------------------------------------
+
+// 5. leaves the cell of 'point_index' in 'polygon', (empty if it has none)
+static void build_cell(u64 point_index, double width, double height) {
+    polygon.count = 0;
+    if (site_is_copy.items[point_index]) return;
+
+    // clockwise, like with_math
+    da_append(&polygon, ((DoubleVector2){    0,      0}));
+    da_append(&polygon, ((DoubleVector2){width,      0}));
+    da_append(&polygon, ((DoubleVector2){width, height}));
+    da_append(&polygon, ((DoubleVector2){    0, height}));
+
+    DoubleVector2 point = sites.items[point_index];
+    for (u32 k = neighbor_start.items[point_index]; k < neighbor_start.items[point_index+1]; k++) {
+        cut_polygon(&polygon, &tmp_poly, point, sites.items[neighbors.items[k]]);
+        if (polygon.count == 0) break;
+    }
+}
+
+
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    // the points on top of other points have no cell, everything else gets covered.
+    for (u64 i = 0; i < width*height; i++) labels[i] = VORONOI_NO_LABEL;
+
+    if (num_points == 0) return;
+
+    build_diagram(points, num_points);
+
+    for (u64 point_index = 0; point_index < num_points; point_index++) {
+        build_cell(point_index, width, height);
+        fill_polygon(labels, width, height, polygon, point_index);
+    }
+
+    fill_cracks(labels, width, height, points);
+}
+
+
+#ifndef VORONOI_HEADLESS
+
+void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
+    if (num_points == 0) return;
+
+    int width  = target.texture.width;
+    int height = target.texture.height;
+
+
+    PROFILER_ZONE("Fortune sweep");
+        build_diagram((float *) points, num_points);
+    PROFILER_ZONE_END();
+
+
+    PROFILER_ZONE("draw cells");
+        BeginTextureMode(target);
+        ClearBackground(GRAY);
+
+        for (u64 point_index = 0; point_index < num_points; point_index++) {
+            build_cell(point_index, width, height);
+            draw_polygon(polygon, colors[point_index], height);
+        }
+
+        EndTextureMode();
+    PROFILER_ZONE_END();
+}
+
+#endif // VORONOI_HEADLESS
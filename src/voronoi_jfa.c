@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "voronoi.h"
+
+#include "common.h"
+#include "thread_pool.h"
+
+#ifndef VORONOI_HEADLESS
+#define PRESENT_IMPLEMENTATION
+#include "present.h"
+#endif // VORONOI_HEADLESS
+
+
+// Jump Flooding: https://en.wikipedia.org/wiki/Jump_flooding_algorithm
+//
+// 1. Put every point into the pixel its in.
+// 2. For step = half the screen, a quarter, ..., 1:
+// 3.     Every pixel looks at the 8 pixels 'step' away from it,
+//        and takes whichever of their points is closest to it.
+// 4. One more pass with step 1, (JFA+1) which fixes most of the mistakes.
+//
+// the cost is O(w*h*log(w)) no matter how many points there are,
+// but its not exact, a pixel can miss its real closest point.
+//
+// every pixel keeps the position of its point next to the index,
+// so a pass only ever reads rows in order, and the compiler can vectorize it.
+
+
+typedef struct Jfa_Buffer {
+    u32   *ids;
+    float *xs;
+    float *ys;
+} Jfa_Buffer;
+
+static Jfa_Buffer buffers[2] = {0};
+static u64 buf_capacity = 0;
+
+static u32 *label_buf = 0;
+static u64 label_capacity = 0;
+
+// one per bit of the screen size, and the extra one.
+#define MAX_PASSES 65
+static u64 steps[MAX_PASSES];
+static u64 num_passes;
+
+
+// the rows of a pass are split over the threads in thread_pool.h,
+// a few at a time, and the next pass starts once they are all done.
+#define THREAD_CHUNK_SIZE 8
+
+// every thread needs a row of distances
+static float **thread_row_dists = 0;
+static u64 row_threads  = 0;
+static u64 row_capacity = 0;
+
+// these can be seen by the threads
+static s64 thread_width;
+static s64 thread_height;
+static u32 *thread_labels;
+static u64 thread_pass;
+
+
+// one pass over a single row, reads 'src' writes 'dst'
+static void jfa_row(Jfa_Buffer src, Jfa_Buffer dst, s64 j, s64 step, float *best_d) {
+    s64 width  = thread_width;
+    s64 height = thread_height;
+
+    // nothing here overlaps, telling the compiler lets it vectorize.
+    u32   *restrict dst_id = &dst.ids[j*width];
+    float *restrict dst_x  = &dst.xs [j*width];
+    float *restrict dst_y  = &dst.ys [j*width];
+    float *restrict dists  = best_d;
+    float y = j;
+
+    // start with the point the pixel already has.
+    {
+        const u32   *restrict src_id = &src.ids[j*width];
+        const float *restrict src_x  = &src.xs [j*width];
+        const float *restrict src_y  = &src.ys [j*width];
+
+        for (s32 i = 0; i < width; i++) {
+            float sx = src_x[i];
+            float sy = src_y[i];
+            dst_id[i] = src_id[i];
+            dst_x [i] = sx;
+            dst_y [i] = sy;
+            // same as seed_soa_nearest() in seed_soa.h, so the distances match.
+            dists [i] = (sx-i)*(sx-i) + (sy-y)*(sy-y);
+        }
+    }
+
+    for (s64 dy = -1; dy <= 1; dy++) {
+        s64 other_j = j + dy*step;
+        if (other_j < 0 || other_j >= height) continue;
+
+        for (s64 dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dy == 0) continue;
+
+            // only the part of the row that has a neighbor on the screen
+            s64 offset = dx*step;
+            s64 start  = offset < 0 ? -offset : 0;
+            s64 end    = offset > 0 ? width - offset : width;
+
+            const u32   *restrict other_id = &src.ids[other_j*width + offset];
+            const float *restrict other_x  = &src.xs [other_j*width + offset];
+            const float *restrict other_y  = &src.ys [other_j*width + offset];
+
+            // s32, converting 64 bit ints to floats doesnt vectorize
+            for (s32 i = start; i < end; i++) {
+                float sx = other_x[i];
+                float sy = other_y[i];
+                u32   id = other_id[i];
+                float d  = (sx-i)*(sx-i) + (sy-y)*(sy-y);
+
+                // lowest index on ties, like the brute force.
+                // (no short circuits, they stop the vectorizing)
+                bool better = (d < dists[i]) | ((d == dists[i]) & (id < dst_id[i]));
+
+                dists [i] = better ? d  : dists [i];
+                dst_id[i] = better ? id : dst_id[i];
+                dst_x [i] = better ? sx : dst_x [i];
+                dst_y [i] = better ? sy : dst_y [i];
+            }
+        }
+    }
+}
+
+static void jfa_rows(void *data, u64 start, u64 end, u64 thread) {
+    (void) data;
+
+    Jfa_Buffer src = buffers[ thread_pass    % 2];
+    Jfa_Buffer dst = buffers[(thread_pass+1) % 2];
+    // the last pass writes straight into the labels.
+    if (thread_pass == num_passes - 1) dst.ids = thread_labels;
+
+    for (u64 j = start; j < end; j++) {
+        jfa_row(src, dst, j, steps[thread_pass], thread_row_dists[thread]);
+    }
+}
+
+
+void init_voronoi(void) {
+    // the threads are in thread_pool.h, shared with everyone else.
+    pool_start();
+}
+
+void finish_voronoi(void) {
+    // free the buffers
+    for (u64 i = 0; i < 2; i++) {
+        free(buffers[i].ids);
+        free(buffers[i].xs);
+        free(buffers[i].ys);
+        buffers[i] = (Jfa_Buffer){0};
+    }
+    buf_capacity = 0;
+
+    for (u64 i = 0; i < row_threads; i++) free(thread_row_dists[i]);
+    free(thread_row_dists);
+    thread_row_dists = 0;
+    row_threads  = 0;
+    row_capacity = 0;
+
+    if (label_buf) free(label_buf);
+    label_buf = 0;
+    label_capacity = 0;
+
+#ifndef VORONOI_HEADLESS
+    present_free();
+#endif // VORONOI_HEADLESS
+
+    pool_stop();
+}
+
+
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    if (num_points == 0) {
+        for (u64 i = 0; i < width*height; i++) labels[i] = VORONOI_NO_LABEL;
+        return;
+    }
+
+    if (buf_capacity < width * height) {
+        buf_capacity = width * height;
+        for (u64 i = 0; i < 2; i++) {
+            free(buffers[i].ids);
+            free(buffers[i].xs);
+            free(buffers[i].ys);
+            buffers[i].ids = malloc(buf_capacity * sizeof(u32));
+            buffers[i].xs  = malloc(buf_capacity * sizeof(float));
+            buffers[i].ys  = malloc(buf_capacity * sizeof(float));
+            assert(buffers[i].ids && buffers[i].xs && buffers[i].ys && "Buy More RAM lol");
+        }
+    }
+    if (row_capacity < width || row_threads != pool_num_threads()) {
+        for (u64 i = 0; i < row_threads; i++) free(thread_row_dists[i]);
+        free(thread_row_dists);
+
+        row_capacity = width > row_capacity ? width : row_capacity;
+        row_threads  = pool_num_threads();
+        thread_row_dists = malloc(row_threads * sizeof(float *));
+        assert(thread_row_dists != NULL && "Buy More RAM lol");
+        for (u64 i = 0; i < row_threads; i++) {
+            thread_row_dists[i] = malloc(row_capacity * sizeof(float));
+            assert(thread_row_dists[i] != NULL && "Buy More RAM lol");
+        }
+    }
+
+
+    // 1. Put every point into the pixel its in.
+    Jfa_Buffer seeds = buffers[0];
+    for (u64 i = 0; i < width*height; i++) {
+        seeds.ids[i] = VORONOI_NO_LABEL;
+        // anything is closer than no point at all.
+        seeds.xs[i] = INFINITY;
+        seeds.ys[i] = INFINITY;
+    }
+
+    for (u64 k = 0; k < num_points; k++) {
+        float x = points[2*k];
+        float y = points[2*k + 1];
+
+        // the points can wander a little off the screen. clamped before they are
+        // made into ints, a NaN or a huge float doesnt fit in one. (NaN goes to 0)
+        float cx = x >= 0 ? x : 0;
+        float cy = y >= 0 ? y : 0;
+        if (cx > width  - 1) cx = width  - 1;
+        if (cy > height - 1) cy = height - 1;
+        s64 i = roundf(cx);
+        s64 j = roundf(cy);
+
+        // two points in one pixel, keep the closer one, (the lower index on ties)
+        u64 index = j*width + i;
+        float old_d = (seeds.xs[index]-i)*(seeds.xs[index]-i) + (seeds.ys[index]-j)*(seeds.ys[index]-j);
+        float new_d = (x-i)*(x-i) + (y-j)*(y-j);
+        if (new_d < old_d) {
+            seeds.ids[index] = k;
+            seeds.xs [index] = x;
+            seeds.ys [index] = y;
+        }
+    }
+
+
+    // 2-4. the passes
+    u64 size = width > height ? width : height;
+    u64 step = 1;
+    while (step < size) step *= 2;
+
+    num_passes = 0;
+    for (step /= 2; step >= 1; step /= 2) {
+        assert(num_passes < MAX_PASSES);
+        steps[num_passes++] = step;
+    }
+    assert(num_passes < MAX_PASSES);
+    steps[num_passes++] = 1;
+
+
+    // setup
+    thread_width  = width;
+    thread_height = height;
+    thread_labels = labels;
+
+    for (thread_pass = 0; thread_pass < num_passes; thread_pass++) {
+        // the next pass reads the rows of the other threads,
+        // pool_for() only comes back when they are all done.
+        pool_for(height, THREAD_CHUNK_SIZE, jfa_rows, NULL);
+    }
+}
+
+
+#ifndef VORONOI_HEADLESS
+
+void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
+    u64 width  = target.texture.width;
+    u64 height = target.texture.height;
+
+    if (label_capacity < width * height) {
+        label_capacity = width * height;
+        free(label_buf);
+        label_buf = malloc(label_capacity * sizeof(u32));
+    }
+
+
+    PROFILER_ZONE("Jump flood");
+        compute_voronoi(label_buf, width, height, (float *) points, num_points);
+        PROFILER_ZONE_ITEMS(width * height);
+    PROFILER_ZONE_END();
+
+
+    PROFILER_ZONE("draw into texture");
+        present_labels(target, label_buf, colors, num_points);
+    PROFILER_ZONE_END();
+}
+
+#endif // VORONOI_HEADLESS
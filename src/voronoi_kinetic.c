@@ -0,0 +1,1114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "voronoi.h"
+
+#include "common.h"
+
+#include "polygon.h"
+
+#ifndef VORONOI_HEADLESS
+#define PRESENT_IMPLEMENTATION
+#include "present.h"
+#endif // VORONOI_HEADLESS
+
+
+// Kinetic Delaunay: https://en.wikipedia.org/wiki/Delaunay_triangulation
+//
+// the points only move a pixel or two between frames, so instead of
+// working everything out again, this keeps the Delaunay triangulation
+// of the points around between calls, and only fixes what moved.
+//
+// 1. For every point that moved:
+// 2.     If none of the triangles around it flip over at its new place, just move it.
+// 3.     Otherwise take it out, and put it back in at its new place.
+// 4.     Flip the edges around it until the triangles are Delaunay again.
+//            (no other point is in the circle through the corners of a triangle)
+// 5. Points that are new get put in, points that are gone get taken out.
+// 6. The voronoi cell of a point is the dual of the triangles around it,
+//        the corners are the centers of the circles through the triangles.
+//        (for a point on the outside, the screen is cut with the mid lines
+//        of the points its connected to instead, its cell goes on forever)
+// 7. Only the cells of the points that moved, or that had a triangle
+//        around them change, are cut out and filled again. the rest of the
+//        labels are the same as last frame.
+//
+// when nothing moves nothing happens, and when a few points move only
+// the triangles and cells around them get touched, so the cost goes with
+// how many points moved, not n*log(n). the points that moved are gone
+// through in the order they are on the screen, (not by index) so the
+// triangles around one are close in memory to the ones around the last.
+//
+// the triangles are stored as half edges, three in a row per triangle,
+// each one knows the point it starts at, and its twin on the triangle next to it.
+// everything is in arrays that are kept between frames, deleted triangles are reused.
+//
+// it starts with one huge triangle around everything, so every real point
+// is always inside. its three corners are points 0, 1 and 2 of the mesh,
+// and point 'i' of the caller is point 'i + NUM_SUPER'.
+
+
+#define NIL ((u32) -1)
+
+// the corners of the big triangle around everything.
+#define NUM_SUPER 3
+// how much bigger than the points the big triangle is.
+#define SUPER_SCALE 4096.0
+// a point further than this (in sizes of the points box) from the middle starts over.
+#define SAFE_SCALE 16.0
+// when the points move further than this on average (in distances between points)
+// fixing the triangles is slower than starting over.
+#define MAX_MOTION 2.0
+
+// a point has about 6 edges, anything over this is broken.
+#define MAX_DEGREE 4096
+// a frame that needs more flips than this gets rebuilt, (or the mesh is broken)
+#define FLIPS_PER_POINT 64
+
+// way more than the rounding error of in_circle(), with doubles
+#define IN_CIRCLE_EPSILON 1e-12
+
+#define NEXT_EDGE(e) ((e) % 3 == 2 ? (e) - 2 : (e) + 1)
+#define PREV_EDGE(e) ((e) % 3 == 0 ? (e) + 2 : (e) - 1)
+
+
+typedef struct Half_Edge {
+    // the point it starts at
+    u32 vertex;
+    // the same edge going the other way, in the triangle next to it, or NIL
+    u32 twin;
+} Half_Edge;
+
+
+// all the arrays are global variables, so they keep their malloc's between draw calls.
+
+// triangle 't' is half_edges[3*t .. 3*t+2]
+static struct {
+    Half_Edge *items;
+    u64 count;
+    u64 capacity;
+} half_edges = {0};
+static struct {
+    bool *items;
+    u64 count;
+    u64 capacity;
+} triangle_alive = {0};
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} free_triangles = {0};
+
+// the points of the mesh, (a polygon, because its already a double vector2 array)
+static Polygon positions = {0};
+// a half edge that starts at the point, if its in the mesh
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} vertex_edge = {0};
+// points on top of another point with a lower index are not in the mesh.
+static struct {
+    bool *items;
+    u64 count;
+    u64 capacity;
+} vertex_in_mesh = {0};
+
+// edges that might not be Delaunay anymore
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} flip_queue = {0};
+static u64 flip_budget;
+
+// where the last search ended, the next point is probably close.
+static u32 last_triangle;
+
+static bool mesh_built = false;
+static u64 mesh_num_points = 0;
+static DoubleVector2 mesh_center;
+static double mesh_size;
+
+// the hole a removed point leaves
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} star_points = {0}, star_edges = {0};
+
+// the points to put in, or move, in the order they are on the screen. (see sort_on_screen())
+typedef struct Insert_Order {
+    u32 key;
+    u32 index;
+} Insert_Order;
+typedef struct Insert_Order_Array {
+    Insert_Order *items;
+    u64 count;
+    u64 capacity;
+} Insert_Order_Array;
+static Insert_Order_Array insert_order = {0}, move_order = {0}, sort_scratch = {0};
+// how many points are in each square, for the counting sort
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} sort_counts = {0};
+
+// the polygons for the cells
+static Polygon polygon   = {0};
+static Polygon tmp_poly  = {0};
+
+// 7. the cells that have to be done again, (mesh points, see mark_dirty())
+static struct {
+    u32 *items;
+    u64 count;
+    u64 capacity;
+} dirty_vertices = {0};
+static struct {
+    bool *items;
+    u64 count;
+    u64 capacity;
+} vertex_dirty = {0};
+// the mesh was built from scratch, so every cell is.
+static bool redraw_all = true;
+
+// the pixels a cell (with a point index) has, or might have, last frame, to clear them when it changes.
+// (a pixel on a crack can go to the cell next to it, so its a bit bigger than the polygon)
+#define CELL_BOX_MARGIN 2
+typedef struct Cell_Box {
+    u32 x0, y0, x1, y1;
+} Cell_Box;
+static struct {
+    Cell_Box *items;
+    u64 count;
+    u64 capacity;
+} cell_boxes = {0};
+
+// last frames labels, most of them are still right
+static u32 *cell_labels = 0;
+static u64 cell_labels_width  = 0;
+static u64 cell_labels_height = 0;
+// the rows of 'cell_labels' the last update touched, unless it did all of them.
+static struct {
+    bool *items;
+    u64 count;
+    u64 capacity;
+} row_dirty = {0};
+static bool all_rows_dirty = true;
+
+
+void init_voronoi(void) {}
+
+void finish_voronoi(void) {
+    da_free(&half_edges);
+    da_free(&triangle_alive);
+    da_free(&free_triangles);
+    da_free(&positions);
+    da_free(&vertex_edge);
+    da_free(&vertex_in_mesh);
+    da_free(&flip_queue);
+    da_free(&star_points);
+    da_free(&star_edges);
+    da_free(&insert_order);
+    da_free(&move_order);
+    da_free(&sort_scratch);
+    da_free(&sort_counts);
+
+    da_free(&polygon);
+    da_free(&tmp_poly);
+
+    da_free(&dirty_vertices);
+    da_free(&vertex_dirty);
+    da_free(&cell_boxes);
+    free(cell_labels);
+    cell_labels = 0;
+    cell_labels_width  = 0;
+    cell_labels_height = 0;
+    da_free(&row_dirty);
+    all_rows_dirty = true;
+    redraw_all = true;
+
+    mesh_built = false;
+    mesh_num_points = 0;
+
+#ifndef VORONOI_HEADLESS
+    present_free();
+#endif // VORONOI_HEADLESS
+}
+
+
+// ---------------------------------------------------
+//              Geometry
+// ---------------------------------------------------
+
+// positive when a, b, c go around the same way as the triangles in the mesh
+static double orient(DoubleVector2 a, DoubleVector2 b, DoubleVector2 c) {
+    return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+}
+
+// positive when 'd' is inside the circle through a, b, c (which have a positive orient())
+// https://en.wikipedia.org/wiki/Delaunay_triangulation#Algorithms
+//
+// its only positive when its sure, a point that is just about on the
+// circle can come out either way, and then two triangles can flip back
+// and forth forever. (the corners of the big triangle make the numbers huge)
+static double in_circle(DoubleVector2 a, DoubleVector2 b, DoubleVector2 c, DoubleVector2 d) {
+    double adx = a.x - d.x, ady = a.y - d.y;
+    double bdx = b.x - d.x, bdy = b.y - d.y;
+    double cdx = c.x - d.x, cdy = c.y - d.y;
+
+    double a_lift = adx*adx + ady*ady;
+    double b_lift = bdx*bdx + bdy*bdy;
+    double c_lift = cdx*cdx + cdy*cdy;
+
+    double det = a_lift*(bdx*cdy - bdy*cdx)
+               + b_lift*(cdx*ady - cdy*adx)
+               + c_lift*(adx*bdy - ady*bdx);
+
+    // how big the rounding error can get
+    double bound = a_lift*(fabs(bdx*cdy) + fabs(bdy*cdx))
+                 + b_lift*(fabs(cdx*ady) + fabs(cdy*adx))
+                 + c_lift*(fabs(adx*bdy) + fabs(ady*bdx));
+
+    if (fabs(det) <= bound * IN_CIRCLE_EPSILON) return 0;
+    return det;
+}
+
+static DoubleVector2 vertex_pos(u32 vertex) {
+    return positions.items[vertex];
+}
+
+static u32 edge_start(u32 e) {
+    return half_edges.items[e].vertex;
+}
+static u32 edge_end(u32 e) {
+    return half_edges.items[NEXT_EDGE(e)].vertex;
+}
+
+// the next edge going out of the same point, (around the same way as the triangles)
+static u32 next_spoke(u32 e) {
+    return half_edges.items[PREV_EDGE(e)].twin;
+}
+
+// 7. the cell of 'vertex' has to be done again
+static void mark_dirty(u32 vertex) {
+    if (vertex < NUM_SUPER || vertex_dirty.items[vertex]) return;
+    vertex_dirty.items[vertex] = true;
+    da_append(&dirty_vertices, vertex);
+}
+
+
+// ---------------------------------------------------
+//              The mesh
+// ---------------------------------------------------
+
+static u32 new_triangle(u32 a, u32 b, u32 c) {
+    u32 t;
+    if (free_triangles.count > 0) {
+        t = free_triangles.items[--free_triangles.count];
+    } else {
+        t = triangle_alive.count;
+        da_append(&triangle_alive, false);
+        for (u64 i = 0; i < 3; i++) da_append(&half_edges, ((Half_Edge){0}));
+    }
+
+    triangle_alive.items[t] = true;
+    half_edges.items[3*t + 0] = (Half_Edge){a, NIL};
+    half_edges.items[3*t + 1] = (Half_Edge){b, NIL};
+    half_edges.items[3*t + 2] = (Half_Edge){c, NIL};
+
+    // the old triangles of these points might be gone now
+    vertex_edge.items[a] = 3*t + 0;
+    vertex_edge.items[b] = 3*t + 1;
+    vertex_edge.items[c] = 3*t + 2;
+
+    // a new triangle, so new neighbours, for all three.
+    // (the points of a triangle that goes away are always in a new one, except the one thats taken out)
+    mark_dirty(a);
+    mark_dirty(b);
+    mark_dirty(c);
+
+    last_triangle = t;
+    return t;
+}
+
+static void free_triangle(u32 t) {
+    triangle_alive.items[t] = false;
+    da_append(&free_triangles, t);
+}
+
+static void link_edges(u32 e1, u32 e2) {
+    if (e1 != NIL) half_edges.items[e1].twin = e2;
+    if (e2 != NIL) half_edges.items[e2].twin = e1;
+}
+
+static void queue_triangle(u32 t) {
+    da_append(&flip_queue, 3*t + 0);
+    da_append(&flip_queue, 3*t + 1);
+    da_append(&flip_queue, 3*t + 2);
+}
+
+
+// the triangles (a, b, c) and (b, a, d) that share the edge 'e' (a -> b)
+// become (c, a, d) and (d, b, c), only ok if both of those are the right way around.
+static bool can_flip(u32 e) {
+    u32 f = half_edges.items[e].twin;
+    if (f == NIL) return false;
+
+    DoubleVector2 a = vertex_pos(edge_start(e));
+    DoubleVector2 b = vertex_pos(edge_end(e));
+    DoubleVector2 c = vertex_pos(edge_start(PREV_EDGE(e)));
+    DoubleVector2 d = vertex_pos(edge_start(PREV_EDGE(f)));
+
+    return orient(c, a, d) > 0 && orient(d, b, c) > 0;
+}
+
+static void flip_edge(u32 e) {
+    u32 f = half_edges.items[e].twin;
+
+    u32 a = edge_start(e);
+    u32 b = edge_end(e);
+    u32 c = edge_start(PREV_EDGE(e));
+    u32 d = edge_start(PREV_EDGE(f));
+
+    // the edges on the outside of the two triangles
+    u32 bc = half_edges.items[NEXT_EDGE(e)].twin;
+    u32 ca = half_edges.items[PREV_EDGE(e)].twin;
+    u32 ad = half_edges.items[NEXT_EDGE(f)].twin;
+    u32 db = half_edges.items[PREV_EDGE(f)].twin;
+
+    free_triangle(e / 3);
+    free_triangle(f / 3);
+
+    u32 t1 = new_triangle(c, a, d);
+    u32 t2 = new_triangle(d, b, c);
+
+    link_edges(3*t1 + 0, ca);
+    link_edges(3*t1 + 1, ad);
+    link_edges(3*t2 + 0, db);
+    link_edges(3*t2 + 1, bc);
+    // the new edge, d -> c and c -> d
+    link_edges(3*t1 + 2, 3*t2 + 2);
+
+    queue_triangle(t1);
+    queue_triangle(t2);
+}
+
+// 4. Flip the edges until the triangles are Delaunay again.
+static bool make_delaunay(void) {
+    while (flip_queue.count > 0) {
+        u32 e = flip_queue.items[--flip_queue.count];
+        // the triangle is gone, (or reused, checking it again doesnt hurt)
+        if (!triangle_alive.items[e / 3]) continue;
+
+        u32 f = half_edges.items[e].twin;
+        if (f == NIL) continue;
+
+        DoubleVector2 a = vertex_pos(edge_start(e));
+        DoubleVector2 b = vertex_pos(edge_end(e));
+        DoubleVector2 c = vertex_pos(edge_start(PREV_EDGE(e)));
+        DoubleVector2 d = vertex_pos(edge_start(PREV_EDGE(f)));
+
+        if (in_circle(a, b, c, d) <= 0) continue;
+        if (!can_flip(e)) continue;
+
+        if (flip_budget == 0) return false;
+        flip_budget -= 1;
+
+        flip_edge(e);
+    }
+    return true;
+}
+
+
+// the triangle 'p' is in, (on the edge counts) or NIL
+static u32 find_triangle(DoubleVector2 p) {
+    u32 t = last_triangle;
+    if (t >= triangle_alive.count || !triangle_alive.items[t]) {
+        for (t = 0; t < triangle_alive.count; t++) {
+            if (triangle_alive.items[t]) break;
+        }
+    }
+
+    // walk towards the point, crossing any edge its on the other side of.
+    // (a delaunay mesh cant make this go in circles, but a broken one can)
+    u64 max_steps = triangle_alive.count + 16;
+    for (u64 step = 0; step < max_steps; step++) {
+        bool moved = false;
+
+        for (u64 k = 0; k < 3; k++) {
+            u32 e = 3*t + (k + step) % 3;
+            if (orient(vertex_pos(edge_start(e)), vertex_pos(edge_end(e)), p) < 0) {
+                u32 twin = half_edges.items[e].twin;
+                // outside the big triangle
+                if (twin == NIL) return NIL;
+
+                t = twin / 3;
+                moved = true;
+                break;
+            }
+        }
+
+        if (!moved) return t;
+    }
+
+    // went in circles, check them all
+    for (t = 0; t < triangle_alive.count; t++) {
+        if (!triangle_alive.items[t]) continue;
+
+        bool inside = true;
+        for (u64 k = 0; k < 3; k++) {
+            u32 e = 3*t + k;
+            if (orient(vertex_pos(edge_start(e)), vertex_pos(edge_end(e)), p) < 0) inside = false;
+        }
+        if (inside) return t;
+    }
+    return NIL;
+}
+
+// the triangle (a, b, c) becomes (a, b, v), (b, c, v) and (c, a, v)
+static void split_triangle(u32 t, u32 v) {
+    u32 a = half_edges.items[3*t + 0].vertex;
+    u32 b = half_edges.items[3*t + 1].vertex;
+    u32 c = half_edges.items[3*t + 2].vertex;
+    u32 ab = half_edges.items[3*t + 0].twin;
+    u32 bc = half_edges.items[3*t + 1].twin;
+    u32 ca = half_edges.items[3*t + 2].twin;
+
+    free_triangle(t);
+
+    u32 t1 = new_triangle(a, b, v);
+    u32 t2 = new_triangle(b, c, v);
+    u32 t3 = new_triangle(c, a, v);
+
+    link_edges(3*t1 + 0, ab);
+    link_edges(3*t2 + 0, bc);
+    link_edges(3*t3 + 0, ca);
+
+    link_edges(3*t1 + 1, 3*t2 + 2); // b -> v, v -> b
+    link_edges(3*t2 + 1, 3*t3 + 2); // c -> v, v -> c
+    link_edges(3*t3 + 1, 3*t1 + 2); // a -> v, v -> a
+
+    queue_triangle(t1);
+    queue_triangle(t2);
+    queue_triangle(t3);
+}
+
+// 'v' is right on the edge 'e' (a -> b), so the triangles
+// (a, b, c) and (b, a, d) become (a, v, c), (v, b, c), (b, v, d) and (v, a, d)
+static void split_edge(u32 e, u32 v) {
+    u32 f = half_edges.items[e].twin;
+    assert(f != NIL && "the points are all inside the big triangle");
+
+    u32 a = edge_start(e);
+    u32 b = edge_end(e);
+    u32 c = edge_start(PREV_EDGE(e));
+    u32 d = edge_start(PREV_EDGE(f));
+
+    u32 bc = half_edges.items[NEXT_EDGE(e)].twin;
+    u32 ca = half_edges.items[PREV_EDGE(e)].twin;
+    u32 ad = half_edges.items[NEXT_EDGE(f)].twin;
+    u32 db = half_edges.items[PREV_EDGE(f)].twin;
+
+    free_triangle(e / 3);
+    free_triangle(f / 3);
+
+    u32 t1 = new_triangle(a, v, c);
+    u32 t2 = new_triangle(v, b, c);
+    u32 t3 = new_triangle(b, v, d);
+    u32 t4 = new_triangle(v, a, d);
+
+    link_edges(3*t1 + 2, ca);
+    link_edges(3*t2 + 1, bc);
+    link_edges(3*t3 + 2, db);
+    link_edges(3*t4 + 1, ad);
+
+    link_edges(3*t1 + 1, 3*t2 + 2); // v -> c, c -> v
+    link_edges(3*t3 + 1, 3*t4 + 2); // v -> d, d -> v
+    link_edges(3*t1 + 0, 3*t4 + 0); // a -> v, v -> a
+    link_edges(3*t2 + 0, 3*t3 + 0); // v -> b, b -> v
+
+    queue_triangle(t1);
+    queue_triangle(t2);
+    queue_triangle(t3);
+    queue_triangle(t4);
+}
+
+// 'v' takes the place of 'w' in the mesh, they are on top of each other.
+static void replace_vertex(u32 w, u32 v) {
+    u32 start = vertex_edge.items[w];
+    u32 e = start;
+    do {
+        half_edges.items[e].vertex = v;
+        e = next_spoke(e);
+    } while (e != start);
+
+    vertex_edge.items[v] = start;
+    vertex_in_mesh.items[v] = true;
+    vertex_in_mesh.items[w] = false;
+
+    // the same cell, with a different label
+    mark_dirty(v);
+    mark_dirty(w);
+}
+
+static bool insert_vertex(u32 v, DoubleVector2 p) {
+    u32 t = find_triangle(p);
+    if (t == NIL) return false;
+
+    positions.items[v] = p;
+
+    // on top of a point thats already there, the lowest index gets the cell, like the brute force.
+    for (u64 k = 0; k < 3; k++) {
+        u32 w = half_edges.items[3*t + k].vertex;
+        DoubleVector2 q = vertex_pos(w);
+        if (q.x == p.x && q.y == p.y) {
+            if (w >= NUM_SUPER && v < w) replace_vertex(w, v);
+            return true;
+        }
+    }
+
+    vertex_in_mesh.items[v] = true;
+
+    for (u64 k = 0; k < 3; k++) {
+        u32 e = 3*t + k;
+        if (orient(vertex_pos(edge_start(e)), vertex_pos(edge_end(e)), p) == 0) {
+            split_edge(e, v);
+            return make_delaunay();
+        }
+    }
+
+    split_triangle(t, v);
+    return make_delaunay();
+}
+
+// take 'v' out, and fill the hole it leaves with new triangles.
+// https://en.wikipedia.org/wiki/Polygon_triangulation#Ear_clipping_method
+static bool remove_vertex(u32 v) {
+    // the points around it, and the edges on the outside of the hole
+    star_points.count = 0;
+    star_edges.count  = 0;
+
+    u32 start = vertex_edge.items[v];
+    u32 e = start;
+    do {
+        if (star_points.count >= MAX_DEGREE) return false;
+
+        da_append(&star_points, edge_end(e));
+        da_append(&star_edges, half_edges.items[NEXT_EDGE(e)].twin);
+        free_triangle(e / 3);
+
+        e = next_spoke(e);
+    } while (e != start);
+
+    vertex_in_mesh.items[v] = false;
+    mark_dirty(v);
+
+    // cut off ears until there is only one triangle left
+    while (star_points.count > 3) {
+        u64 count = star_points.count;
+        bool clipped = false;
+
+        for (u64 i = 0; i < count; i++) {
+            u64 prev = (i + count - 1) % count;
+            u64 next = (i + 1) % count;
+
+            DoubleVector2 a = vertex_pos(star_points.items[prev]);
+            DoubleVector2 b = vertex_pos(star_points.items[i]);
+            DoubleVector2 c = vertex_pos(star_points.items[next]);
+            if (orient(a, b, c) <= 0) continue;
+
+            // no other point can be in it, (or on its edges)
+            bool empty = true;
+            for (u64 k = 0; k < count; k++) {
+                if (k == prev || k == i || k == next) continue;
+                DoubleVector2 q = vertex_pos(star_points.items[k]);
+                if (orient(a, b, q) >= 0 && orient(b, c, q) >= 0 && orient(c, a, q) >= 0) {
+                    empty = false;
+                    break;
+                }
+            }
+            if (!empty) continue;
+
+            u32 t = new_triangle(star_points.items[prev], star_points.items[i], star_points.items[next]);
+            link_edges(3*t + 0, star_edges.items[prev]);
+            link_edges(3*t + 1, star_edges.items[i]);
+            queue_triangle(t);
+
+            // the new edge (c -> a) is on the outside of what is left of the hole
+            star_edges.items[prev] = 3*t + 2;
+            for (u64 k = i; k + 1 < count; k++) {
+                star_points.items[k] = star_points.items[k+1];
+                star_edges.items[k]  = star_edges.items[k+1];
+            }
+            star_points.count -= 1;
+            star_edges.count  -= 1;
+
+            clipped = true;
+            break;
+        }
+
+        if (!clipped) return false;
+    }
+
+    u32 t = new_triangle(star_points.items[0], star_points.items[1], star_points.items[2]);
+    link_edges(3*t + 0, star_edges.items[0]);
+    link_edges(3*t + 1, star_edges.items[1]);
+    link_edges(3*t + 2, star_edges.items[2]);
+    queue_triangle(t);
+
+    return make_delaunay();
+}
+
+// 2. none of the triangles around 'v' flip over, if it moves to 'p'
+static bool can_move(u32 v, DoubleVector2 p) {
+    u32 start = vertex_edge.items[v];
+    u32 e = start;
+    do {
+        DoubleVector2 a = vertex_pos(edge_end(e));
+        DoubleVector2 b = vertex_pos(edge_start(PREV_EDGE(e)));
+        if (orient(p, a, b) <= 0) return false;
+        e = next_spoke(e);
+    } while (e != start);
+    return true;
+}
+
+static bool move_vertex(u32 v, DoubleVector2 p) {
+    if (can_move(v, p)) {
+        positions.items[v] = p;
+
+        // every edge of the triangles around it might not be Delaunay anymore,
+        // and the cells around it have a new mid line.
+        mark_dirty(v);
+        u32 start = vertex_edge.items[v];
+        u32 e = start;
+        do {
+            da_append(&flip_queue, e);
+            da_append(&flip_queue, NEXT_EDGE(e));
+            mark_dirty(edge_end(e));
+            e = next_spoke(e);
+        } while (e != start);
+
+        last_triangle = start / 3;
+        return make_delaunay();
+    }
+
+    // 3. Otherwise take it out, and put it back in at its new place.
+    if (!remove_vertex(v)) return false;
+    return insert_vertex(v, p);
+}
+
+
+static double clamp_double(double x, double low, double high) {
+    if (x < low)  return low;
+    if (x > high) return high;
+    return x;
+}
+
+// sorts 'order' so it goes through a grid of squares row by row, (going back and
+// forth) about two points a square. every point is close to the last one, so the
+// search doesnt have to go far, and the triangles it touches are probably in the cache.
+// (a counting sort, so its O(n), qsort() was a good part of a frame)
+static void sort_on_screen(Insert_Order_Array *order, const float *points) {
+    if (order->count < 2) return;
+
+    u64 size = sqrt(order->count / 2) + 1;
+    double min_x = mesh_center.x - mesh_size/2;
+    double min_y = mesh_center.y - mesh_size/2;
+
+    da_reserve(&sort_counts, size*size + 1);
+    sort_counts.count = size*size + 1;
+    memset(sort_counts.items, 0, sort_counts.count * sizeof(*sort_counts.items));
+
+    for (u64 k = 0; k < order->count; k++) {
+        u32 i = order->items[k].index;
+        u64 row = clamp_double((points[2*i + 1] - min_y) / mesh_size * size, 0, size - 1);
+        u64 col = clamp_double((points[2*i]     - min_x) / mesh_size * size, 0, size - 1);
+        if (row % 2) col = size - 1 - col;
+
+        order->items[k].key = row*size + col;
+        sort_counts.items[order->items[k].key + 1] += 1;
+    }
+    for (u64 i = 1; i < sort_counts.count; i++) sort_counts.items[i] += sort_counts.items[i - 1];
+
+    da_reserve(&sort_scratch, order->count);
+    sort_scratch.count = order->count;
+    for (u64 k = 0; k < order->count; k++) {
+        Insert_Order it = order->items[k];
+        sort_scratch.items[sort_counts.items[it.key]++] = it;
+    }
+
+    SWAP(*order, sort_scratch);
+}
+
+// put the points in 'insert_order' in, in the order they are on the screen.
+static bool insert_in_order(const float *points) {
+    sort_on_screen(&insert_order, points);
+
+    bool ok = true;
+    for (u64 k = 0; k < insert_order.count; k++) {
+        u32 i = insert_order.items[k].index;
+        DoubleVector2 p = {points[2*i], points[2*i + 1]};
+        if (!insert_vertex(i + NUM_SUPER, p)) ok = false;
+    }
+    return ok;
+}
+
+// throw the mesh away, and put all the points in from scratch.
+static void build_mesh(const float *points, u64 num_points) {
+    half_edges.count = 0;
+    triangle_alive.count = 0;
+    free_triangles.count = 0;
+    flip_queue.count = 0;
+
+    // the box around the points
+    double min_x = points[0], max_x = points[0];
+    double min_y = points[1], max_y = points[1];
+    for (u64 i = 1; i < num_points; i++) {
+        if (min_x > points[2*i])     min_x = points[2*i];
+        if (max_x < points[2*i])     max_x = points[2*i];
+        if (min_y > points[2*i + 1]) min_y = points[2*i + 1];
+        if (max_y < points[2*i + 1]) max_y = points[2*i + 1];
+    }
+
+    mesh_center = (DoubleVector2){(min_x + max_x) / 2, (min_y + max_y) / 2};
+    mesh_size = max_x - min_x > max_y - min_y ? max_x - min_x : max_y - min_y;
+    if (mesh_size < 1) mesh_size = 1;
+
+    // the big triangle
+    double r = mesh_size * SUPER_SCALE;
+    positions.items[0] = (DoubleVector2){mesh_center.x,             mesh_center.y - r};
+    positions.items[1] = (DoubleVector2){mesh_center.x - 0.866*r,   mesh_center.y + 0.5*r};
+    positions.items[2] = (DoubleVector2){mesh_center.x + 0.866*r,   mesh_center.y + 0.5*r};
+    if (orient(positions.items[0], positions.items[1], positions.items[2]) < 0) SWAP(positions.items[1], positions.items[2]);
+
+    for (u64 v = 0; v < vertex_in_mesh.count; v++) vertex_in_mesh.items[v] = false;
+    new_triangle(0, 1, 2);
+
+    mesh_built = true;
+    redraw_all = true;
+    mesh_num_points = num_points;
+
+
+    insert_order.count = 0;
+    for (u64 i = 0; i < num_points; i++) da_append(&insert_order, ((Insert_Order){0, i}));
+
+    // cant do anything about it here, the points that dont go in just wont get a cell.
+    insert_in_order(points);
+}
+
+// steps 1-5, false if the mesh broke, and needs to be built again.
+static bool update_mesh(const float *points, u64 num_points) {
+    // 5. points that are gone get taken out
+    for (u64 i = num_points; i < mesh_num_points; i++) {
+        u32 v = i + NUM_SUPER;
+        if (vertex_in_mesh.items[v] && !remove_vertex(v)) return false;
+        vertex_in_mesh.items[v] = false;
+    }
+    mesh_num_points = num_points;
+
+    insert_order.count = 0;
+    move_order.count   = 0;
+    for (u64 i = 0; i < num_points; i++) {
+        u32 v = i + NUM_SUPER;
+
+        // 5. new points, (or ones that were on top of another one) get put in after
+        if (!vertex_in_mesh.items[v]) {
+            da_append(&insert_order, ((Insert_Order){0, i}));
+            continue;
+        }
+
+        DoubleVector2 old = positions.items[v];
+        if (old.x != points[2*i] || old.y != points[2*i + 1]) da_append(&move_order, ((Insert_Order){0, i}));
+    }
+
+    // 1. For every point that moved:
+    sort_on_screen(&move_order, points);
+    for (u64 k = 0; k < move_order.count; k++) {
+        u32 i = move_order.items[k].index;
+        DoubleVector2 p = {points[2*i], points[2*i + 1]};
+        if (!move_vertex(i + NUM_SUPER, p)) return false;
+    }
+
+    return insert_in_order(points);
+}
+
+// the big triangle was made for where the points used to be.
+static bool points_too_far(const float *points, u64 num_points) {
+    double max_distance = mesh_size * SAFE_SCALE;
+    for (u64 i = 0; i < num_points; i++) {
+        if (fabs(points[2*i]     - mesh_center.x) > max_distance) return true;
+        if (fabs(points[2*i + 1] - mesh_center.y) > max_distance) return true;
+    }
+    return false;
+}
+
+// the points moved so much (or there are so many new ones) its not worth fixing.
+static bool points_moved_a_lot(const float *points, u64 num_points) {
+    if (num_points > 2*mesh_num_points) return true;
+
+    double total = 0;
+    u64 count = 0;
+    for (u64 i = 0; i < num_points && i < mesh_num_points; i++) {
+        u32 v = i + NUM_SUPER;
+        if (!vertex_in_mesh.items[v]) continue;
+
+        DoubleVector2 old = positions.items[v];
+        total += fabs(points[2*i] - old.x) + fabs(points[2*i + 1] - old.y);
+        count += 1;
+    }
+    if (count == 0) return true;
+
+    // about how far apart the points are
+    double spacing = mesh_size / sqrt(count);
+    return total / count > MAX_MOTION * spacing;
+}
+
+static void setup_mesh(const float *points, size_t num_points) {
+    while (positions.count < num_points + NUM_SUPER) {
+        da_append(&positions, ((DoubleVector2){0, 0}));
+        da_append(&vertex_edge, NIL);
+        da_append(&vertex_in_mesh, false);
+        da_append(&vertex_dirty, false);
+    }
+
+    flip_budget = FLIPS_PER_POINT * (num_points + 1);
+
+    if (!mesh_built || points_too_far(points, num_points) || points_moved_a_lot(points, num_points)) {
+        build_mesh(points, num_points);
+    }
+
+    if (!update_mesh(points, num_points)) {
+        // with floats some things that should be impossible arent,
+        // just start over, (and live with it if that breaks too)
+        flip_budget = FLIPS_PER_POINT * (num_points + 1);
+        build_mesh(points, num_points);
+        update_mesh(points, num_points);
+    }
+}
+
+
+// ---------------------------------------------------
+//                  The cells
+// ---------------------------------------------------
+
+// the center of the circle through the corners of triangle 't'. always worked out
+// from the same corner, so the cells on either side of an edge get the exact same ends.
+static DoubleVector2 circle_center(u32 t) {
+    DoubleVector2 a = vertex_pos(half_edges.items[3*t + 0].vertex);
+    DoubleVector2 b = vertex_pos(half_edges.items[3*t + 1].vertex);
+    DoubleVector2 c = vertex_pos(half_edges.items[3*t + 2].vertex);
+
+    // https://en.wikipedia.org/wiki/Circumcircle#Cartesian_coordinates_2
+    double bx = b.x - a.x, by = b.y - a.y;
+    double cx = c.x - a.x, cy = c.y - a.y;
+    double d = 2 * (bx*cy - by*cx);
+    double b_lift = bx*bx + by*by;
+    double c_lift = cx*cx + cy*cy;
+
+    return (DoubleVector2){
+        a.x + (cy*b_lift - by*c_lift) / d,
+        a.y + (bx*c_lift - cx*b_lift) / d,
+    };
+}
+
+// 6. leaves the cell of 'point_index' in 'polygon', (empty if it has none)
+static void build_cell(u64 point_index, double width, double height) {
+    polygon.count = 0;
+
+    u32 v = point_index + NUM_SUPER;
+    if (!vertex_in_mesh.items[v]) return;
+
+    // the corners are the centers of the triangles around it, in order.
+    // fill_polygon() only fills whats on the screen, so nothing has to be cut off.
+    u32 start = vertex_edge.items[v];
+    u32 e = start;
+    bool outside = false;
+    do {
+        if (edge_end(e) < NUM_SUPER) {
+            outside = true;
+            break;
+        }
+        da_append(&polygon, circle_center(e / 3));
+        e = next_spoke(e);
+    } while (e != start);
+    if (!outside) return;
+
+    // its next to the big triangle, so its cell has no end.
+    // cut it out of the screen, clockwise, like with_math
+    polygon.count = 0;
+    da_append(&polygon, ((DoubleVector2){    0,      0}));
+    da_append(&polygon, ((DoubleVector2){width,      0}));
+    da_append(&polygon, ((DoubleVector2){width, height}));
+    da_append(&polygon, ((DoubleVector2){    0, height}));
+
+    DoubleVector2 point = vertex_pos(v);
+    e = start;
+    do {
+        u32 other = edge_end(e);
+        // the big triangle isnt a real point
+        if (other >= NUM_SUPER) cut_polygon(&polygon, &tmp_poly, point, vertex_pos(other));
+        if (polygon.count == 0) break;
+        e = next_spoke(e);
+    } while (e != start);
+}
+
+// build_cell() and fill_polygon(), and remember where it went
+static void fill_cell(u64 point_index, u64 width, u64 height) {
+    build_cell(point_index, width, height);
+    fill_polygon(cell_labels, width, height, polygon, point_index);
+
+    Cell_Box box = {0};
+    if (polygon.count >= 3) {
+        double min_x = polygon.items[0].x, max_x = polygon.items[0].x;
+        double min_y = polygon.items[0].y, max_y = polygon.items[0].y;
+        for (u64 i = 1; i < polygon.count; i++) {
+            if (min_x > polygon.items[i].x) min_x = polygon.items[i].x;
+            if (max_x < polygon.items[i].x) max_x = polygon.items[i].x;
+            if (min_y > polygon.items[i].y) min_y = polygon.items[i].y;
+            if (max_y < polygon.items[i].y) max_y = polygon.items[i].y;
+        }
+        // the same rounding as fill_polygon()
+        box.x0 = clamp_double(ceil(min_x) - CELL_BOX_MARGIN, 0, width);
+        box.x1 = clamp_double(ceil(max_x) + CELL_BOX_MARGIN, 0, width);
+        box.y0 = clamp_double(ceil(min_y) - CELL_BOX_MARGIN, 0, height);
+        box.y1 = clamp_double(ceil(max_y) + CELL_BOX_MARGIN, 0, height);
+    }
+    cell_boxes.items[point_index] = box;
+}
+
+static void mark_rows(Cell_Box box) {
+    for (u64 y = box.y0; y < box.y1; y++) row_dirty.items[y] = true;
+}
+
+static void resize_labels(u64 width, u64 height) {
+    if (cell_labels_width == width && cell_labels_height == height) return;
+
+    free(cell_labels);
+    cell_labels = malloc(width * height * sizeof(u32));
+    assert(cell_labels != NULL && "Buy More RAM lol");
+    cell_labels_width  = width;
+    cell_labels_height = height;
+
+    row_dirty.count = 0;
+    while (row_dirty.count < height) da_append(&row_dirty, false);
+    redraw_all = true;
+}
+
+// no points, no cells. the next frame with points starts over.
+static void clear_labels(u64 width, u64 height) {
+    resize_labels(width, height);
+    for (u64 i = 0; i < width*height; i++) cell_labels[i] = VORONOI_NO_LABEL;
+    all_rows_dirty = true;
+    redraw_all = true;
+}
+
+// 7. brings 'cell_labels' up to date with the mesh
+static void update_labels(u64 width, u64 height, const float *points, u64 num_points) {
+    resize_labels(width, height);
+    while (cell_boxes.count < num_points) da_append(&cell_boxes, ((Cell_Box){0}));
+    memset(row_dirty.items, 0, height * sizeof(bool));
+
+    // going over the boxes of the cells is about twice the pixels the cells have,
+    // so when most of them changed, doing them all in one go is less work.
+    if (2*dirty_vertices.count > num_points) redraw_all = true;
+    all_rows_dirty = redraw_all;
+
+    if (redraw_all) {
+        // the points on top of other points have no cell, everything else gets covered.
+        for (u64 i = 0; i < width*height; i++) cell_labels[i] = VORONOI_NO_LABEL;
+
+        // in the order they are on the screen, like the points that moved,
+        // the triangles and pixels of one cell are close to the ones of the last.
+        insert_order.count = 0;
+        for (u64 i = 0; i < num_points; i++) da_append(&insert_order, ((Insert_Order){0, i}));
+        sort_on_screen(&insert_order, points);
+        for (u64 k = 0; k < insert_order.count; k++) fill_cell(insert_order.items[k].index, width, height);
+        for (u64 i = num_points; i < cell_boxes.count; i++) cell_boxes.items[i] = (Cell_Box){0};
+        fill_cracks(cell_labels, width, height, points);
+    } else {
+        // a cell that didnt change has the same pixels as last frame, so the ones that
+        // changed cover the same pixels all together, just split up differently.
+        // clear them all first, a cell that got smaller leaves them to one thats still to come.
+        for (u64 k = 0; k < dirty_vertices.count; k++) {
+            u64 i = dirty_vertices.items[k] - NUM_SUPER;
+            if (i >= cell_boxes.count) continue;
+
+            Cell_Box box = cell_boxes.items[i];
+            mark_rows(box);
+            for (u64 y = box.y0; y < box.y1; y++) {
+                for (u64 x = box.x0; x < box.x1; x++) {
+                    if (cell_labels[y*width + x] == i) cell_labels[y*width + x] = VORONOI_NO_LABEL;
+                }
+            }
+            cell_boxes.items[i] = (Cell_Box){0};
+        }
+
+        for (u64 k = 0; k < dirty_vertices.count; k++) {
+            u64 i = dirty_vertices.items[k] - NUM_SUPER;
+            if (i < num_points) fill_cell(i, width, height);
+        }
+
+        // the cracks are all next to a cell that changed
+        for (u64 k = 0; k < dirty_vertices.count; k++) {
+            u64 i = dirty_vertices.items[k] - NUM_SUPER;
+            if (i >= num_points) continue;
+
+            Cell_Box box = cell_boxes.items[i];
+            mark_rows(box);
+            fill_cracks_rect(cell_labels, width, height, points, box.x0, box.y0, box.x1, box.y1);
+        }
+    }
+
+    for (u64 k = 0; k < dirty_vertices.count; k++) vertex_dirty.items[dirty_vertices.items[k]] = false;
+    dirty_vertices.count = 0;
+    redraw_all = false;
+}
+
+
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    if (num_points == 0) {
+        clear_labels(width, height);
+    } else {
+        setup_mesh(points, num_points);
+        update_labels(width, height, points, num_points);
+    }
+
+    // the callers buffer can be a different one every frame, (frame_writer.h has two)
+    memcpy(labels, cell_labels, width * height * sizeof(u32));
+}
+
+
+#ifndef VORONOI_HEADLESS
+
+void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
+    u64 width  = target.texture.width;
+    u64 height = target.texture.height;
+
+    if (num_points == 0) {
+        clear_labels(width, height);
+    } else {
+        PROFILER_ZONE("Fix the triangles");
+            setup_mesh((float *) points, num_points);
+        PROFILER_ZONE_END();
+
+        PROFILER_ZONE("fill cells");
+            update_labels(width, height, (float *) points, num_points);
+            PROFILER_ZONE_ITEMS(num_points);
+        PROFILER_ZONE_END();
+    }
+
+
+    PROFILER_ZONE("draw into texture");
+        // only the rows the cells that changed are on, when nothing moved thats none of them.
+        const bool *rows = all_rows_dirty ? NULL : row_dirty.items;
+        present_labels_rows(target, cell_labels, colors, num_points, rows);
+    PROFILER_ZONE_END();
+}
+
+#endif // VORONOI_HEADLESS
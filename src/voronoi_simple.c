@@ -1,4 +1,3 @@
-
 #include <stdlib.h>
 #include <assert.h>
 
@@ -6,78 +5,106 @@
 
 #include "common.h"
 
-static Color *pixel_buf = 0;
+#include "seed_grid.h"
+#include "seed_soa.h"
+#include "seed_coherence.h"
+
+#ifndef VORONOI_HEADLESS
+#define PRESENT_IMPLEMENTATION
+#include "present.h"
+#endif // VORONOI_HEADLESS
+
+static u32 *label_buf = 0;
 static u64 buf_capacity = 0;
 
-float dist_sqr(float x1, float y1, float x2, float y2) {
-    return (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2);
-}
+// below this many points, checking all of them beats the grid.
+// (with the SIMD brute force in seed_soa.h, and the tiles in seed_coherence.h, about 64)
+#ifndef GRID_MIN_POINTS
+#define GRID_MIN_POINTS 64
+#endif // GRID_MIN_POINTS
+static Seed_Grid grid = {0};
+// for the brute force, when there arent many points.
+static Seed_Soa soa = {0};
+
+// last frame's labels, every tile starts from the points it had then,
+// and the tiles no point moved near just keep them.
+#define TILE_SIZE SEED_COHERENCE_TILE
+static Seed_Coherence coherence = {0};
+static Seed_Coherence_Scratch scratch = {0};
 
 void init_voronoi(void) {}
 
 void finish_voronoi(void) {
     // free the buffer
-    if (pixel_buf) free(pixel_buf);
-    pixel_buf = 0;
+    if (label_buf) free(label_buf);
+    label_buf = 0;
     buf_capacity = 0;
+
+    seed_grid_free(&grid);
+    seed_soa_free(&soa);
+    seed_coherence_free(&coherence);
+    seed_coherence_scratch_free(&scratch);
+
+#ifndef VORONOI_HEADLESS
+    present_free();
+#endif // VORONOI_HEADLESS
 }
 
 
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    if (num_points == 0) {
+        seed_coherence_forget(&coherence);
+        for (u64 i = 0; i < width*height; i++) labels[i] = VORONOI_NO_LABEL;
+        return;
+    }
+
+    if (num_points < GRID_MIN_POINTS) {
+        seed_coherence_forget(&coherence);
+        seed_soa_build(&soa, points, num_points);
+        seed_soa_sort(&soa);
+        // with this few points, a row is only a few runs, most pixels are just filled in.
+        seed_soa_spans(&soa, labels, width, 0, 0, width, height);
+        return;
+    }
+
+    // when nothing moved, the grid isnt even needed.
+    seed_coherence_begin(&coherence, points, num_points, width, height);
+    if (coherence.num_dirty > 0) seed_grid_build(&grid, points, num_points, width, height);
+
+    for (u64 y0 = 0; y0 < height; y0 += TILE_SIZE) {
+        for (u64 x0 = 0; x0 < width; x0 += TILE_SIZE) {
+            u64 x1 = x0 + TILE_SIZE < width  ? x0 + TILE_SIZE : width;
+            u64 y1 = y0 + TILE_SIZE < height ? y0 + TILE_SIZE : height;
+            seed_coherence_rect(&coherence, &scratch, &grid, points, labels, x0, y0, x1, y1);
+        }
+    }
+}
+
+
+#ifndef VORONOI_HEADLESS
+
 void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
     u64 width  = target.texture.width;
     u64 height = target.texture.height;
 
     if (buf_capacity < width * height) {
         buf_capacity = width * height;
-        free(pixel_buf);
-        pixel_buf = malloc(buf_capacity * sizeof(Color));
+        free(label_buf);
+        label_buf = malloc(buf_capacity * sizeof(u32));
     }
 
 
     PROFILER_ZONE("Calculate pixel buffer");
-
-        for (u64 j = 0; j < height; j++) {
-            for (u64 i = 0; i < width; i++) {
-
-                // find the closest point
-                u64 close_index = 0;
-                float d1 = dist_sqr(points[0].x, points[0].y, i, j);
-                for (u64 k = 1; k < num_points; k++) {
-                    float d2 = dist_sqr(points[k].x, points[k].y, i, j);
-                    if (d2 < d1) {
-                        d1 = d2;
-                        close_index = k;
-                    }
-                }
-
-                pixel_buf[j * width + i] = colors[close_index];
-            }
-        }
-
+        compute_voronoi(label_buf, width, height, (float *) points, num_points);
+        PROFILER_ZONE_ITEMS(width * height);
     PROFILER_ZONE_END();
 
 
     PROFILER_ZONE("draw into texture");
-    BeginTextureMode(target);
-
-    for (u64 j = 0; j < height; j++) {
-        // find a band of the same color.
-        // this is MUCH faster than just useing DrawPixel()
-        u64 i = 0;
-        while (i < width) {
-            u64 low_i = i;
-            Color this_color = pixel_buf[j*width + i];
-            for (; i < width; i++) {
-                if (!ColorIsEqual(this_color, pixel_buf[j*width + i])) break;
-            }
-
-            // remember to draw this upsidedown.
-            // bc how textures work, and the API demands it.
-            DrawRectangle(low_i, height - 1 - j, i - low_i, 1, this_color);
-        }
-    }
-
-    EndTextureMode();
+        // the grid path knows which rows it didnt touch
+        const bool *rows = num_points >= GRID_MIN_POINTS ? coherence.row_dirty : NULL;
+        present_labels_rows(target, label_buf, colors, num_points, rows);
     PROFILER_ZONE_END();
 }
 
+#endif // VORONOI_HEADLESS
@@ -1,191 +1,159 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
 
 #include "voronoi.h"
 
 #include "common.h"
 
-static Color *pixel_buf = 0;
-static u64 buf_capacity = 0;
+#include "seed_grid.h"
+#include "seed_soa.h"
+#include "seed_coherence.h"
+#include "thread_pool.h"
 
-float dist_sqr(float x1, float y1, float x2, float y2) {
-    return (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2);
-}
+#ifndef VORONOI_HEADLESS
+#define PRESENT_IMPLEMENTATION
+#include "present.h"
+#endif // VORONOI_HEADLESS
 
-// because VSCode is being stupid
-// we need this for barriers
-#ifndef __USE_XOPEN2K
-#define __USE_XOPEN2K
-#endif // __USE_XOPEN2K
+static u32 *label_buf = 0;
+static u64 buf_capacity = 0;
 
-#include <pthread.h>
+// below this many points, checking all of them beats the grid.
+// (with the SIMD brute force in seed_soa.h, and the tiles in seed_coherence.h, about 64)
+#ifndef GRID_MIN_POINTS
+#define GRID_MIN_POINTS 64
+#endif // GRID_MIN_POINTS
+static Seed_Grid grid = {0};
+// for the brute force, when there arent many points.
+static Seed_Soa soa = {0};
+
+// last frame's labels, every tile starts from the points it had then,
+// and the tiles no point moved near just keep them.
+static Seed_Coherence coherence = {0};
+// one for every thread
+static Seed_Coherence_Scratch *scratches = 0;
+static u64 num_scratches = 0;
+
+// the screen is cut into square tiles, that the threads take one at a time.
+// a square touches less rows than a line of the same size, so its friendlier
+// to the cache, and the points it needs from the grid are all close together.
+// (and the smaller they are, the less points seed_coherence.h has to check for each)
+#define TILE_SIZE SEED_COHERENCE_TILE
 
-#define NUM_THREADS 12
+// these can be seen by the threads
+static u64 thread_width;
+static u32 *thread_labels;
+static const float *thread_points;
 
-pthread_t thread_ids[NUM_THREADS];
-pthread_barrier_t start_barrier;
-pthread_barrier_t end_barrier;
-bool finished;
+static void do_tile(void *data, u64 x0, u64 y0, u64 x1, u64 y1, u64 thread) {
+    (void) data;
+    seed_coherence_rect(&coherence, &scratches[thread], &grid, thread_points, thread_labels, x0, y0, x1, y1);
+}
 
-#define THREAD_CHUNK_SIZE 512
-pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
-u64 counter;
+// without the grid the rows are a few runs each, those are done whole.
+#define ROW_CHUNK_SIZE 8
 
-// these can be seen by the threads
-u64 thread_width;
-u64 thread_height;
-Vector2 *thread_points;
-Color *thread_colors;
-u64 thread_num_points;
-
-void *thread_function(void *args) {
-    u64 id = (u64) args;
-    (void) id;
-
-    while (1) {
-        pthread_barrier_wait(&start_barrier);
-        if (finished) break;
-
-        // grab a chunk of the work, and do it.
-        while (1) {
-            u64 work_to_do;
-            pthread_mutex_lock(&counter_lock);
-
-            if (counter < thread_width * thread_height) {
-                work_to_do = counter;
-                counter += THREAD_CHUNK_SIZE;
-
-            } else {
-                // were finished
-                pthread_mutex_unlock(&counter_lock);
-                break;
-            }
-
-            pthread_mutex_unlock(&counter_lock);
-
-            for (u64 i = work_to_do; i < work_to_do + THREAD_CHUNK_SIZE; i++) {
-                if (i >= thread_width * thread_height) break;
-
-                float x = (float) (i % thread_width);
-                float y = (float) (i / thread_width);
-
-                // find the closest point
-                u64 close_index = 0;
-                float d1 = dist_sqr(thread_points[0].x, thread_points[0].y, x, y);
-                for (u64 k = 1; k < thread_num_points; k++) {
-                    float d2 = dist_sqr(thread_points[k].x, thread_points[k].y, x, y);
-                    if (d2 < d1) {
-                        d1 = d2;
-                        close_index = k;
-                    }
-                }
-
-                // thread_pixel_buf[i] = thread_colors[close_index];
-                pixel_buf[i] = thread_colors[close_index];
-            }
-
-            // repeat chunk loop
-        }
+static void do_rows(void *data, u64 start, u64 end, u64 thread) {
+    (void) data;
+    (void) thread;
+    seed_soa_spans(&soa, &thread_labels[start * thread_width], thread_width, 0, start, thread_width, end);
+}
 
-        pthread_barrier_wait(&end_barrier);
-    }
 
-    return NULL;
+void init_voronoi(void) {
+    // the threads are in thread_pool.h, shared with everyone else.
+    pool_start();
 }
 
+void finish_voronoi(void) {
+    // free the buffer
+    if (label_buf) free(label_buf);
+    label_buf = 0;
+    buf_capacity = 0;
 
-void init_voronoi(void) {
+    seed_grid_free(&grid);
+    seed_soa_free(&soa);
 
-    if (pthread_barrier_init(&start_barrier, NULL, NUM_THREADS+1)) {
-        fprintf(stderr, "ERROR: cannot init start barrier\n");
-        exit(1);
-    }
-    if (pthread_barrier_init(&end_barrier, NULL, NUM_THREADS+1)) {
-        fprintf(stderr, "ERROR: cannot init end barrier\n");
-        exit(1);
-    }
+    seed_coherence_free(&coherence);
+    for (u64 i = 0; i < num_scratches; i++) seed_coherence_scratch_free(&scratches[i]);
+    free(scratches);
+    scratches = 0;
+    num_scratches = 0;
 
-    finished = false;
+#ifndef VORONOI_HEADLESS
+    present_free();
+#endif // VORONOI_HEADLESS
 
-    // start the threads
-    for (u64 i = 0; i < NUM_THREADS; i++) {
-        int res = pthread_create(&thread_ids[i], NULL, thread_function, (void *) i);
-        if (res) {
-            fprintf(stderr, "ERROR: thread could not be created\n");
-            exit(1);
-        }
-    }
+    pool_stop();
 }
 
-void finish_voronoi(void) {
-    // free the buffer
-    if (pixel_buf) free(pixel_buf);
-    pixel_buf = 0;
-    buf_capacity = 0;
 
-    finished = true;
-    pthread_barrier_wait(&start_barrier);
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    if (num_points == 0) {
+        seed_coherence_forget(&coherence);
+        for (u64 i = 0; i < width*height; i++) labels[i] = VORONOI_NO_LABEL;
+        return;
+    }
+
+    // the grid (or the soa) is only read by the threads, so build it before they start.
+    bool use_grid = num_points >= GRID_MIN_POINTS;
+    if (use_grid) {
+        // when nothing moved, the grid isnt even needed.
+        seed_coherence_begin(&coherence, points, num_points, width, height);
+        if (coherence.num_dirty > 0) seed_grid_build(&grid, points, num_points, width, height);
+
+        if (num_scratches != pool_num_threads()) {
+            for (u64 i = 0; i < num_scratches; i++) seed_coherence_scratch_free(&scratches[i]);
+            free(scratches);
 
-    // finish the treads
-    for (u64 i = 0; i < NUM_THREADS; i++) {
-        int ret = pthread_join(thread_ids[i], NULL);
-        if (ret) {
-            fprintf(stderr, "ERROR: on id %zu when closeing\n", i);
+            num_scratches = pool_num_threads();
+            scratches = calloc(num_scratches, sizeof(Seed_Coherence_Scratch));
+            assert(scratches != NULL && "Buy More RAM lol");
         }
+    } else {
+        // the tiles that didnt change are only known on the grid path
+        seed_coherence_forget(&coherence);
+        seed_soa_build(&soa, points, num_points);
+        seed_soa_sort(&soa);
     }
 
-    pthread_barrier_destroy(&start_barrier);
-    pthread_barrier_destroy(&end_barrier);
+    // setup
+    thread_width  = width;
+    thread_labels = labels;
+    thread_points = points;
+
+    if (use_grid) pool_for_tiles(width, height, TILE_SIZE, do_tile, NULL);
+    else          pool_for(height, ROW_CHUNK_SIZE, do_rows, NULL);
 }
 
 
+#ifndef VORONOI_HEADLESS
+
 void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
     u64 width  = target.texture.width;
     u64 height = target.texture.height;
 
     if (buf_capacity < width * height) {
         buf_capacity = width * height;
-        free(pixel_buf);
-        pixel_buf = malloc(buf_capacity * sizeof(Color));
+        free(label_buf);
+        label_buf = malloc(buf_capacity * sizeof(u32));
     }
 
 
     PROFILER_ZONE("Calculate pixel buffer");
-
-        // setup
-        thread_width  = width;
-        thread_height = height;
-        thread_points = points;
-        thread_colors = colors;
-        thread_num_points = num_points;
-        counter = 0;
-
-        // start the waiting threads
-        pthread_barrier_wait(&start_barrier);
-        // wait for them to stop
-        pthread_barrier_wait(&end_barrier);
-
+        compute_voronoi(label_buf, width, height, (float *) points, num_points);
+        PROFILER_ZONE_ITEMS(width * height);
     PROFILER_ZONE_END();
 
 
     PROFILER_ZONE("draw into texture");
-    BeginTextureMode(target);
-
-    for (u64 j = 0; j < height; j++) {
-        u64 i = 0;
-        while (i < width) {
-            u64 low_i = i;
-            Color this_color = pixel_buf[j*width + i];
-            for (; i < width; i++) {
-                if (!ColorIsEqual(this_color, pixel_buf[j*width + i])) break;
-            }
-
-            DrawRectangle(low_i, height - 1 - j, i - low_i, 1, this_color);
-        }
-    }
-
-    EndTextureMode();
+        // the grid path knows which rows it didnt touch
+        const bool *rows = num_points >= GRID_MIN_POINTS ? coherence.row_dirty : NULL;
+        present_labels_rows(target, label_buf, colors, num_points, rows);
     PROFILER_ZONE_END();
 }
 
+#endif // VORONOI_HEADLESS
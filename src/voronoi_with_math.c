@@ -1,155 +1,290 @@
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <assert.h>
+#include <math.h>
+#include <stdbool.h>
 
 #include "voronoi.h"
 
+#ifndef VORONOI_HEADLESS
 #include "raymath.h"
+#include "rlgl.h"
+#endif // VORONOI_HEADLESS
 
 #include "common.h"
 
+#include "polygon.h"
+#include "seed_grid.h"
+#include "thread_pool.h"
 
-#define SWAP(a, b) do {typeof(a) tmp = a; a = b; b = tmp;} while(0)
-
-
-typedef struct DoubleVector2 {
-    double x, y;
-} DoubleVector2;
 
+// the triangles of the cells, 'point_index' picks the color.
+typedef struct Cell_Vertex {
+    float x, y;
+    u32 point_index;
+} Cell_Vertex;
 
-typedef struct Polygon {
-    // the points of the polygon
-    DoubleVector2 *items;
+typedef struct Cell_Vertices {
+    Cell_Vertex *items;
     u64 count;
     u64 capacity;
-} Polygon;
+} Cell_Vertices;
 
-#include <stdio.h>
+// every thread cuts its own cells, so it needs its own polygons.
+// they are global variables, so they keep their malloc's between draw calls.
+typedef struct Cell_Scratch {
+    Polygon polygon;
+    Polygon tmp_poly;
+    // every triangle of every cell this thread did, for draw_voronoi()
+    Cell_Vertices vertices;
+} Cell_Scratch;
 
-// draw a convex polygon, with points in clockwise order
-// flip height, if not zero, flip vertical
-void draw_polygon(Polygon polygon, Color color, int flip_height) {
-    for (u64 i = 1; i < polygon.count - 1; i++) {
-        Vector2 v1 = {polygon.items[0  ].x, polygon.items[0  ].y};
-        Vector2 v2 = {polygon.items[i  ].x, polygon.items[i  ].y};
-        Vector2 v3 = {polygon.items[i+1].x, polygon.items[i+1].y};
+static Polygon points_double = {0};
 
-        if (flip_height) {
-            v1.y = flip_height - v1.y;
-            v2.y = flip_height - v2.y;
-            v3.y = flip_height - v3.y;
+// the points sorted into cells, so the closest ones can be checked first.
+static Seed_Grid grid = {0};
 
-            SWAP(v2, v3);
-        }
 
-        // DrawLineEx(v1, v2, 10, GOLD);
-        // DrawLineEx(v2, v3, 10, GOLD);
-        // DrawLineEx(v1, v3, 10, GOLD);
+// one for every thread in thread_pool.h
+static Cell_Scratch *scratches = 0;
+static u64 num_scratches = 0;
 
-        // draw the points in reverse order, because the polygon is always clockwise.
-        DrawTriangle(v3, v2, v1, color);
-    }
-}
+// the cells are small, but some take longer than others.
+#define THREAD_CHUNK_SIZE 64
 
-// TODO actually use floating inf
-#define FINF 999999999.0f
+// these can be seen by the threads
+static u64 thread_width;
+static u64 thread_height;
+// fill the cells in here, or if its NULL, make triangles out of them.
+static u32 *thread_labels;
 
-// https://en.wikipedia.org/wiki/Line%E2%80%93line_intersection
-DoubleVector2 line_line_intersection(DoubleVector2 p1, DoubleVector2 p2, DoubleVector2 p3, DoubleVector2 p4) {
-    float w = (p1.x - p2.x)*(p3.y - p4.y) - (p1.y - p2.y)*(p3.x - p4.x);
 
-    if (w == 0) {
-        // parallel or coincident, return junk number
-        return (DoubleVector2){FINF, FINF};
+static void setup_points(const float *points, size_t num_points, u64 width, u64 height) {
+    // useing this polygon as a double vector2 array
+    points_double.count = 0;
+    for (u64 i = 0; i < num_points; i++) {
+        da_append(&points_double, ((DoubleVector2){(double)points[2*i], (double)points[2*i + 1]}));
     }
 
-    float d_x = (p1.x*p2.y - p1.y*p2.x)*(p3.x - p4.x) - (p1.x - p2.x)*(p3.x*p4.y - p3.y*p4.x);
-    float d_y = (p1.x*p2.y - p1.y*p2.x)*(p3.y - p4.y) - (p1.y - p2.y)*(p3.x*p4.y - p3.y*p4.x);
-
-    // intersection points.
-    float i_x = d_x / w;
-    float i_y = d_y / w;
+    seed_grid_build(&grid, points, num_points, width, height);
+}
 
-    return (DoubleVector2){i_x, i_y};
+// how far the corner of 'polygon' thats furthest from 'point' is, squared.
+static double furthest_corner_sqr(Polygon polygon, DoubleVector2 point) {
+    double furthest = 0;
+    for (u64 i = 0; i < polygon.count; i++) {
+        double dx = polygon.items[i].x - point.x;
+        double dy = polygon.items[i].y - point.y;
+        if (furthest < dx*dx + dy*dy) furthest = dx*dx + dy*dy;
+    }
+    return furthest;
 }
 
-// check if two line points, are intersected with a point
-// that is known to intersect with it.
-bool intersection_point_intersects(DoubleVector2 p1, DoubleVector2 p2, DoubleVector2 intersect) {
-    if (p1.x == p2.x) {
-        // vertical line
+// cuts the scratch polygon with all the points in a cell of the grid,
+// skipping the ones that are too far away to touch it.
+// 'furthest' is furthest_corner_sqr(), kept up to date.
+static void cut_with_grid_cell(Cell_Scratch *scratch, u64 point_index, s64 cx, s64 cy, double *furthest) {
+    DoubleVector2 point = points_double.items[point_index];
+
+    // the whole grid cell can be too far away, (the edge cells go on forever)
+    double cell_dx = 0, cell_dy = 0;
+    if (cx > 0           && point.x < cx*grid.cell_size)     cell_dx = cx*grid.cell_size - point.x;
+    if (cx < grid.cols-1 && point.x > (cx+1)*grid.cell_size) cell_dx = point.x - (cx+1)*grid.cell_size;
+    if (cy > 0           && point.y < cy*grid.cell_size)     cell_dy = cy*grid.cell_size - point.y;
+    if (cy < grid.rows-1 && point.y > (cy+1)*grid.cell_size) cell_dy = point.y - (cy+1)*grid.cell_size;
+    cell_dx -= SEED_GRID_EPSILON;
+    cell_dy -= SEED_GRID_EPSILON;
+    if (cell_dx < 0) cell_dx = 0;
+    if (cell_dy < 0) cell_dy = 0;
+    if (cell_dx*cell_dx + cell_dy*cell_dy > 4 * *furthest) return;
+
+    s64 c = cy*grid.cols + cx;
+    for (u32 k = grid.cell_start[c]; k < grid.cell_start[c+1]; k++) {
+        u32 other_point_index = grid.ids[k];
+        if (other_point_index == point_index) continue;
+
+        // the grid has its own copy of the points, in order, so this doesnt jump around memory.
+        DoubleVector2 other_point = {grid.xs[k], grid.ys[k]};
+
+        // right on top of each other, the lower index gets the cell, (like the brute force)
+        if (other_point.x == point.x && other_point.y == point.y) {
+            if (other_point_index < point_index) {
+                scratch->polygon.count = 0;
+                *furthest = 0;
+            }
+            continue;
+        }
 
-        // assert p1 has smaller y
-        if (p2.y < p1.y) SWAP(p1, p2);
+        // the mid line is half way to the other point, so if thats further
+        // than every corner of the polygon, it cant cut anything off.
+        double dx = other_point.x - point.x;
+        double dy = other_point.y - point.y;
+        if (dx*dx + dy*dy > 4 * *furthest) continue;
 
-        // if its between the correct y range. is good
-        if (p1.y < intersect.y && intersect.y < p2.y) {
-            return true;
-        } else {
-            return false;
-        }
+        // 4. Find the mid line parallel to those point
+        // 5. Cut the polygon and keep the side that is close to the original point
+        cut_polygon(&scratch->polygon, &scratch->tmp_poly, point, other_point);
+        *furthest = furthest_corner_sqr(scratch->polygon, point);
+    }
+}
 
-    } else if (p1.y == p2.y) {
-        // horizontal line
+// steps 2-6 of the algorithm in draw_voronoi(),
+// leaves the cell of 'point_index' in 'scratch->polygon'.
+static void build_cell(Cell_Scratch *scratch, u64 point_index, double width, double height) {
+    DoubleVector2 point = points_double.items[point_index];
+
+    // 2. Construct a polygon that fills the screen
+    Polygon *polygon = &scratch->polygon;
+    polygon->count = 0;
+    da_append(polygon, ((DoubleVector2){    0,      0}));
+    da_append(polygon, ((DoubleVector2){width,      0}));
+    da_append(polygon, ((DoubleVector2){width, height}));
+    da_append(polygon, ((DoubleVector2){    0, height}));
 
-        // assert p1 has smaller x
-        if (p2.x < p1.x) SWAP(p1, p2);
 
-        if (p1.x < intersect.x && intersect.x < p2.x) {
-            return true;
+    // 3. For every other point, closest first:
+    //
+    // the points are in a grid, so check the cell the point is in, then
+    // the ring of cells around that, and the ring around that...
+    s64 cx = seed_grid_cell_x(&grid, point.x);
+    s64 cy = seed_grid_cell_y(&grid, point.y);
+    double furthest = furthest_corner_sqr(*polygon, point);
+
+    for (s64 r = 0; ; r++) {
+        s64 x0 = cx - r, x1 = cx + r;
+        s64 y0 = cy - r, y1 = cy + r;
+
+        if (r == 0) {
+            cut_with_grid_cell(scratch, point_index, cx, cy, &furthest);
         } else {
-            return false;
+            // the top and bottom rows of the ring
+            for (s64 i = seed_grid_clamp(x0, 0, grid.cols-1); i <= seed_grid_clamp(x1, 0, grid.cols-1); i++) {
+                if (y0 >= 0)        cut_with_grid_cell(scratch, point_index, i, y0, &furthest);
+                if (y1 < grid.rows) cut_with_grid_cell(scratch, point_index, i, y1, &furthest);
+            }
+            // the left and right sides, without the corners
+            for (s64 j = seed_grid_clamp(y0+1, 0, grid.rows-1); j <= seed_grid_clamp(y1-1, 0, grid.rows-1); j++) {
+                if (x0 >= 0)        cut_with_grid_cell(scratch, point_index, x0, j, &furthest);
+                if (x1 < grid.cols) cut_with_grid_cell(scratch, point_index, x1, j, &furthest);
+            }
         }
 
-    } else {
-        // general case
-        // just check that the intersect is within the x range
+        // 6. Repeat 4-5 until all other points have been considered.
+        if (x0 <= 0 && y0 <= 0 && x1 >= grid.cols-1 && y1 >= grid.rows-1) break;
 
-        // assert p1 has smaller x
-        if (p2.x < p1.x) SWAP(p1, p2);
+        // or until everything left is more than 2x the furthest corner away,
+        // (same bound as seed_grid_nearest(), points past the edge live in the edge cells)
+        double bound = INFINITY;
+        if (x0 > 0)             bound = fmin(bound, point.x - x0*grid.cell_size);
+        if (y0 > 0)             bound = fmin(bound, point.y - y0*grid.cell_size);
+        if (x1 < grid.cols - 1) bound = fmin(bound, (x1+1)*grid.cell_size - point.x);
+        if (y1 < grid.rows - 1) bound = fmin(bound, (y1+1)*grid.cell_size - point.y);
+        bound -= SEED_GRID_EPSILON;
 
-        if (p1.x < intersect.x && intersect.x < p2.x) {
-            return true;
-        } else {
-            return false;
-        }
+        if (bound > 0 && bound*bound > 4*furthest) break;
     }
-
-    assert(false && "Unreachable");
 }
 
-// https://stackoverflow.com/questions/1560492/how-to-tell-whether-a-point-is-to-the-right-or-left-side-of-a-line
-bool isLeft(DoubleVector2 a, DoubleVector2 b, DoubleVector2 c) {
-    return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x) > 0;
+
+// step 7, the same triangles draw_polygon() would draw.
+static void add_triangles(Cell_Vertices *vertices, Polygon polygon, u32 point_index, u64 flip_height) {
+    if (polygon.count < 3) return;
+
+    for (u64 i = 1; i < polygon.count - 1; i++) {
+        Cell_Vertex v1 = {polygon.items[0  ].x, flip_height - polygon.items[0  ].y, point_index};
+        Cell_Vertex v2 = {polygon.items[i  ].x, flip_height - polygon.items[i  ].y, point_index};
+        Cell_Vertex v3 = {polygon.items[i+1].x, flip_height - polygon.items[i+1].y, point_index};
+
+        // flipped, so its counter clockwise now.
+        da_append(vertices, v1);
+        da_append(vertices, v2);
+        da_append(vertices, v3);
+    }
 }
 
+static void build_cells(void *data, u64 start, u64 end, u64 thread) {
+    (void) data;
+    Cell_Scratch *scratch = &scratches[thread];
 
-// the polygons are global variables, so they keep their malloc's between draw calls.
-Polygon polygon;
-Polygon tmp_poly1;
-Polygon tmp_poly2;
+    for (u64 point_index = start; point_index < end; point_index++) {
+        // 1. Get a point.
+        // 2-6. cut it down
+        build_cell(scratch, point_index, thread_width, thread_height);
 
-Polygon points_double = {0};
+        if (thread_labels) {
+            // the cells dont overlap, (give or take a rounding error on
+            // the edges, where either label is right) so no locking.
+            fill_polygon(thread_labels, thread_width, thread_height, scratch->polygon, point_index);
+        } else {
+            // 7. Convert the resulting convex polygon into triangles
+            add_triangles(&scratch->vertices, scratch->polygon, point_index, thread_height);
+        }
+    }
+}
 
 
 void init_voronoi(void) {
+    // the threads are in thread_pool.h, shared with everyone else.
+    pool_start();
+
     // clear the polygon's
-    polygon   = (Polygon){0};
-    tmp_poly1 = (Polygon){0};
-    tmp_poly2 = (Polygon){0};
+    num_scratches = pool_num_threads();
+    scratches = malloc(num_scratches * sizeof(Cell_Scratch));
+    assert(scratches != NULL && "Buy More RAM lol");
+    for (u64 i = 0; i < num_scratches; i++) scratches[i] = (Cell_Scratch){0};
 
     points_double = (Polygon){0};
 }
 
 void finish_voronoi(void) {
-    da_free(&polygon);
-    da_free(&tmp_poly1);
-    da_free(&tmp_poly2);
+    for (u64 i = 0; i < num_scratches; i++) {
+        da_free(&scratches[i].polygon);
+        da_free(&scratches[i].tmp_poly);
+        da_free(&scratches[i].vertices);
+    }
+    free(scratches);
+    scratches = 0;
+    num_scratches = 0;
 
     da_free(&points_double);
+    seed_grid_free(&grid);
+
+    pool_stop();
 }
 
 
+// steps 1-7 for every point, on all the threads.
+// fills 'labels' if its not NULL, otherwise leaves the triangles in the scratches.
+static void build_all_cells(u32 *labels, u64 width, u64 height, u64 num_points) {
+    // setup
+    thread_width  = width;
+    thread_height = height;
+    thread_labels = labels;
+    for (u64 i = 0; i < num_scratches; i++) scratches[i].vertices.count = 0;
+
+    pool_for(num_points, THREAD_CHUNK_SIZE, build_cells, NULL);
+}
+
+
+void compute_voronoi(u32 *labels, size_t width, size_t height, const float *points, size_t num_points) {
+    // the same as ClearBackground() in draw_voronoi(),
+    // any gaps between the cells belong to no one.
+    for (u64 i = 0; i < width*height; i++) labels[i] = VORONOI_NO_LABEL;
+
+    if (num_points == 0) return;
+
+    // the threads only read these, so set them up before they start.
+    setup_points(points, num_points, width, height);
+
+    build_all_cells(labels, width, height, num_points);
+
+    fill_cracks(labels, width, height, points);
+}
+
+
+#ifndef VORONOI_HEADLESS
+
 void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t num_points) {
     if (num_points == 0) return;
 
@@ -157,15 +292,11 @@ void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t
     int height = target.texture.height;
 
 
-    BeginTextureMode(target);
-    ClearBackground(GRAY);
-
-
     // how to draw voronoi with just math, and not checking every pixel:
     //
     // 1. Get a point.
     // 2. Construct a polygon that fills the screen
-    // 3. For every other point:
+    // 3. For every other point, (closest first, see build_cell())
     // 4.     Find the mid line parallel to those point
     // 5.     Cut the polygon and keep the side that is close to the original point
     // 6.     Repeat 4-5 until all other points have been considered.
@@ -211,167 +342,48 @@ void draw_voronoi(RenderTexture2D target, Vector2 *points, Color *colors, size_t
     // (the above algorithm is still O(n^2) in the worst case, but the average
     // case is O(n*c))
     //
+    // (build_cell() does this now, with the seed grid as the spacial array.
+    // every cell only looks at the points in the rings of grid cells around it,
+    // and stops once the next ring is more than 2x the furthest corner away.)
+    //
     // ALSO NOTE: this solution get 600 points before dropping below 60fps,
     // and that is without, useing multithreading, (witch the optimized solution above
     // will also be acceptable to.), a 5x-6x speedup is easily possible.
+    //
+    // (the cells are cut on all the threads now, every thread makes
+    // the triangles for its cells, and they all get drawn in one go.)
 
 
-    // useing this polygon as a double vector2 array
-    points_double.count = 0;
-    for (u64 i = 0; i < num_points; i++) {
-        da_append(&points_double, ((DoubleVector2){(double)points[i].x, (double)points[i].y}));
-    }
-
-
-    for (u64 point_index = 0; point_index < num_points; point_index++) {
-        // 1. Get a point.
-        DoubleVector2 point = points_double.items[point_index];
-
-        // 2. Construct a polygon that fills the screen
-        polygon.count = 0;
-        da_append(&polygon, ((DoubleVector2){    0,      0}));
-        da_append(&polygon, ((DoubleVector2){width,      0}));
-        da_append(&polygon, ((DoubleVector2){width, height}));
-        da_append(&polygon, ((DoubleVector2){    0, height}));
-
-
-        // 3. For every other point:
-        for (u64 other_point_index = 0; other_point_index < num_points; other_point_index++) {
-            if (other_point_index == point_index) continue;
-
-            DoubleVector2 other_point = points_double.items[other_point_index];
-
-            // 4. Find the mid line parallel to those point
-
-            // the points in here form a perpendicular line.
-            DoubleVector2 perpendicular_points[2];
-            {
-                DoubleVector2 p1 = point;
-                DoubleVector2 p2 = other_point;
-
-                // mid point
-                // m = (p1 + p2) / 2
-                DoubleVector2 m = {(p1.x + p2.x) / 2, (p1.y + p2.y) / 2};
-
-                // direction vector
-                // v = p2 - p1
-                DoubleVector2 v = {p2.x - p1.x, p2.y - p1.y}; // Vector2Subtract(p2, p1);
-
-                // rotated 90 direction vector
-                // v1 = (-v.y, v.x)
-                DoubleVector2 v_1 = {-v.y, v.x};
-
-                // add to the mid point
-                // m1 = m + v1
-                DoubleVector2 m_1 = {m.x + v_1.x, m.y + v_1.y}; // Vector2Add(m, v_1);
-
-                perpendicular_points[0] = m;
-                perpendicular_points[1] = m_1;
-            }
-
-
-            // 5. Cut the polygon and keep the side that is close to the original point
-            DoubleVector2 intersection_points[2];
-            u64 intersection_points_i[2];
-            u64 intersection_points_count = 0;
-
-            // loop over all edges
-            for (u64 i = 0; i < polygon.count; i++) {
-                DoubleVector2 p1 = polygon.items[i];
-                DoubleVector2 p2 = polygon.items[(i+1)%polygon.count];
-
-                // perpendicular points.
-                DoubleVector2 p3 = perpendicular_points[0];
-                DoubleVector2 p4 = perpendicular_points[1];
+    PROFILER_ZONE("cut the cells");
+        setup_points((float *) points, num_points, width, height);
+        build_all_cells(NULL, width, height, num_points);
+    PROFILER_ZONE_END();
 
-                // get intersection
-                DoubleVector2 intersect = line_line_intersection(p1, p2, p3, p4);
 
-                // if the line segment intersects with the intersect point, add it to the intersection array.
-                if (intersection_point_intersects(p1, p2, intersect)) {
+    PROFILER_ZONE("draw cells");
+        BeginTextureMode(target);
+        ClearBackground(GRAY);
 
-                    if (intersection_points_count == 2) {
-                        // TODO debug this
-                        // printf("WTF %zu\n", intersection_points_count);
-                        continue;
-                    }
-                    intersection_points[intersection_points_count] = intersect;
-                    intersection_points_i[intersection_points_count] = i;
-                    intersection_points_count += 1;
-                }
-            }
+        // all the triangles in one batch, instead of a DrawTriangle() each.
+        rlBegin(RL_TRIANGLES);
+        for (u64 t = 0; t < num_scratches; t++) {
+            Cell_Vertices vertices = scratches[t].vertices;
 
-            if (!(intersection_points_count == 0 || intersection_points_count == 2)) {
-                // TODO debug this
-                // printf("intersection_points_count: %zu\n", intersection_points_count);
-            }
+            for (u64 i = 0; i < vertices.count; i += 3) {
+                // when the batch is full, raylib sends it off and starts a new one.
+                rlCheckRenderBatchLimit(3);
 
-            // check if the line intersected the polygon.
-            // this should either be 0 (for when the line missed)
-            // or 2 (where it entered and exited)
-            //
-            // (however this is somewhat broken, possibly because of float precision?)
-            if (intersection_points_count == 2) {
-                // cut the polygon into 2
-
-                // reset the tmp polygons
-                tmp_poly1.count = 0;
-                tmp_poly2.count = 0;
-
-                // index that loops over the points in the polygon
-                u64 index = 0;
-
-                // add points to the first polygon until we get to the first intersection point
-                while (index != intersection_points_i[0]) {
-                    da_append(&tmp_poly1, polygon.items[index]);
-                    index++;
-                }
-                // add the start of the intersected line and the first intersection point.
-                da_append(&tmp_poly1, polygon.items[index]);
-                da_append(&tmp_poly1, intersection_points[0]);
-
-                // second polygon starts from here with the first intersection point
-                da_append(&tmp_poly2, intersection_points[0]);
-                // loop unil the next intersect
-                index++;
-                while (index != intersection_points_i[1]) {
-                    da_append(&tmp_poly2, polygon.items[index]);
-                    index++;
-                }
-                // same as before and the point and the second intersect
-                da_append(&tmp_poly2, polygon.items[index]);
-                da_append(&tmp_poly2, intersection_points[1]);
-
-                // and add the second intersection the the first polygon
-                da_append(&tmp_poly1, intersection_points[1]);
-                // finally add the rest to the first polygon
-                index++;
-                while (index < polygon.count) {
-                    da_append(&tmp_poly1, polygon.items[index]);
-                    index++;
-                }
-
-
-                // now we have 2 polygons,
-                // find the one that contains the original point and keep it.
-                //
-                // dont ask why this function works, dont know.
-                if (isLeft(intersection_points[0], intersection_points[1], point)) {
-                    // the left one contains the point.
-                    SWAP(polygon, tmp_poly1);
-                } else {
-                    // the right one contains the point.
-                    SWAP(polygon, tmp_poly2);
-                }
+                Color color = colors[vertices.items[i].point_index];
+                rlColor4ub(color.r, color.g, color.b, color.a);
+                rlVertex2f(vertices.items[i  ].x, vertices.items[i  ].y);
+                rlVertex2f(vertices.items[i+1].x, vertices.items[i+1].y);
+                rlVertex2f(vertices.items[i+2].x, vertices.items[i+2].y);
             }
-
-            // 6. Repeat 4-5 until all other points have been considered.
         }
+        rlEnd();
 
-        // 7. Convert the resulting convex polygon into triangles and draw them (maybe the bounding lines as well.)
-        draw_polygon(polygon, colors[point_index], height);
-    }
-
-    EndTextureMode();
+        EndTextureMode();
+    PROFILER_ZONE_END();
 }
 
+#endif // VORONOI_HEADLESS